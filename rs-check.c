@@ -0,0 +1,386 @@
+#include "rs-common.h"
+
+#define HAVE_DECL_BASENAME 1
+#include <libiberty.h>
+#undef HAVE_DECL_BASENAME
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Records with up to this number of fields are checked against exhaustive
+// search over all field orders
+#define MAX_BRUTE_FORCE_FIELDS 8
+
+// Layout solver to be timed. Returns estimated (or found) record size in bits.
+struct Solver
+{
+  const char* name;
+  size_t (*solve)(struct RecordInfo* ri);
+};
+
+static uint64_t rngState = 1;
+
+// xorshift64*, we need reproducible sequence for given seed only
+static uint64_t randomValue()
+{
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return rngState * 2685821657736338717ULL;
+}
+
+static size_t randomRange(size_t limit)
+{
+  return randomValue() % limit;
+}
+
+static struct FieldInfo* createField(const char* name, size_t size, size_t align, bool isSpecial)
+{
+  struct FieldInfo* fi = (struct FieldInfo*)xcalloc(1, sizeof(struct FieldInfo));
+  fi->name = xstrdup(name);
+  fi->typeName = xstrdup("");
+  fi->size = size;
+  fi->align = align;
+  fi->naturalAlign = align;
+  fi->isSpecial = isSpecial;
+  return fi;
+}
+
+// Generate record with power-of-two aligned fields (size is multiple of
+// alignment like for any C type) and optional base. Fields are laid out in
+// declaration order like compiler does.
+static struct RecordInfo* generateRecord(size_t fieldCount, bool hasBase)
+{
+  struct RecordInfo* ri = (struct RecordInfo*)xcalloc(1, sizeof(struct RecordInfo));
+  ri->name = xstrdup("Random");
+  ri->fileName = xstrdup("");
+  ri->templateName = xstrdup("");
+  ri->fields = (struct FieldInfo**)xmalloc((fieldCount + 1) * sizeof(struct FieldInfo*));
+  ri->align = 8;
+
+  size_t offset = 0;
+  if (hasBase)
+  {
+    const size_t align = 8 << randomRange(4);
+    struct FieldInfo* fi = createField("base/vptr", align * (1 + randomRange(3)), align, true);
+    ri->fields[ri->fieldCount++] = fi;
+    offset = fi->size;
+    ri->align = align;
+  }
+
+  ri->firstField = ri->fieldCount;
+  for (size_t i = 0; i < fieldCount; i++)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "f%zu", i);
+    const size_t align = 8 << randomRange(5);
+    struct FieldInfo* fi = createField(name, align * (1 + randomRange(3)), align, false);
+    if (offset % align)
+      offset += align - offset % align;
+    fi->offset = offset;
+    offset += fi->size;
+    ri->fields[ri->fieldCount++] = fi;
+    if (align > ri->align)
+      ri->align = align;
+  }
+
+  if (offset % ri->align)
+    offset += ri->align - offset % ri->align;
+  // Empty record still takes one byte
+  ri->size = offset ? offset : 8;
+  ri->naturalAlign = ri->align;
+  ri->estMinSize = SIZE_MAX;
+  return ri;
+}
+
+// Find minimal size over all orders of non-special fields (Heap's algorithm)
+static size_t bruteForceMinSize(const struct RecordInfo* ri)
+{
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  memcpy(fields, ri->fields, ri->fieldCount * sizeof(struct FieldInfo*));
+  struct FieldInfo** regular = fields + ri->firstField;
+  const size_t n = ri->fieldCount - ri->firstField;
+
+  size_t counters[MAX_BRUTE_FORCE_FIELDS] = {0};
+  size_t minSize = layoutFieldsSize(ri, fields);
+  size_t i = 1;
+  while (i < n)
+  {
+    if (counters[i] < i)
+    {
+      const size_t j = i % 2 ? counters[i] : 0;
+      struct FieldInfo* fi = regular[j];
+      regular[j] = regular[i];
+      regular[i] = fi;
+
+      const size_t size = layoutFieldsSize(ri, fields);
+      if (size < minSize)
+        minSize = size;
+
+      counters[i]++;
+      i = 1;
+    }
+    else
+      counters[i++] = 0;
+  }
+
+  free(fields);
+  return minSize;
+}
+
+// Returns number of records which estimation exceeds real minimum. Records
+// overestimated due to padding after bases are known caveat, they are counted
+// only if strict is set.
+static size_t checkBruteForce(size_t recordCount, bool strict)
+{
+  size_t overestimated = 0;
+  size_t afterBases = 0;
+  size_t inexact = 0;
+  for (size_t r = 0; r < recordCount; r++)
+  {
+    struct RecordInfo* ri = generateRecord(1 + randomRange(MAX_BRUTE_FORCE_FIELDS), randomRange(4) == 0);
+    estimateMinRecordSize(ri);
+    const size_t minSize = bruteForceMinSize(ri);
+
+    // Estimation must be lower bound of what reordering can achieve, otherwise
+    // we miss oversized records. Estimator doesn't fit members into padding
+    // between bases and first field (see caveats), such records are counted
+    // separately.
+    if (ri->estMinSize > minSize && ri->firstField)
+    {
+      printf("Mismatch due to padding after bases: estimated %zu byte(s), best order gives %zu byte(s)\n",
+        ri->estMinSize / 8, minSize / 8);
+      printRecordInfo(stdout, ri, true);
+      afterBases++;
+    }
+    else if (ri->estMinSize > minSize)
+    {
+      printf("Mismatch: estimated %zu byte(s), best order gives %zu byte(s)\n", ri->estMinSize / 8, minSize / 8);
+      printRecordInfo(stdout, ri, true);
+      overestimated++;
+    }
+    else if (ri->estMinSize < minSize)
+      inexact++;
+
+    deleteRecordInfo(ri);
+  }
+
+  printf("Exhaustive search: %zu record(s), %zu overestimated, %zu overestimated due to padding after bases, "
+    "%zu estimated below reachable size\n", recordCount, overestimated, afterBases, inexact);
+  return overestimated + (strict ? afterBases : 0);
+}
+
+// Emit field as array of aligned units, so any size/alignment pair can be
+// expressed without relying on target type sizes
+static void writeFieldDecl(FILE* file, const struct FieldInfo* fi)
+{
+  fprintf(file, "  Unit<%zu> %s[%zu];\n", fi->align / 8, fi->name, fi->size / fi->align);
+}
+
+// Compare declaration order layout and estimation with sizeof() reported by
+// C++ compiler. Returns number of mismatches.
+static size_t checkCompiler(const char* cxx, size_t recordCount)
+{
+  char dirName[] = "/tmp/rs-check-XXXXXX";
+  if (!mkdtemp(dirName))
+  {
+    printf("Can't create temporary directory, compiler check skipped\n");
+    return 0;
+  }
+  char* sourceName = concat(dirName, "/records.cpp", NULL);
+  char* binaryName = concat(dirName, "/records", NULL);
+
+  FILE* source = fopen(sourceName, "w");
+  if (!source)
+  {
+    printf("Can't create %s: %s, compiler check skipped\n", sourceName, strerror(errno));
+    rmdir(dirName);
+    free(binaryName);
+    free(sourceName);
+    return 0;
+  }
+  struct RecordInfo** records = (struct RecordInfo**)xmalloc(recordCount * sizeof(struct RecordInfo*));
+  fprintf(source, "#include <cstdio>\n\ntemplate <unsigned A> struct alignas(A) Unit { char c[A]; };\n\n");
+  for (size_t r = 0; r < recordCount; r++)
+  {
+    struct RecordInfo* ri = records[r] = generateRecord(1 + randomRange(16), randomRange(4) == 0);
+    estimateMinRecordSize(ri);
+
+    if (ri->firstField)
+    {
+      fprintf(source, "struct Base%zu\n{\n", r);
+      fprintf(source, "  Unit<%zu> b[%zu];\n", ri->fields[0]->align / 8, ri->fields[0]->size / ri->fields[0]->align);
+      fprintf(source, "};\n\n");
+    }
+
+    // Declaration order and decreasing alignment order, latter should reach
+    // estimated minimal size
+    for (int sorted = 0; sorted < 2; sorted++)
+    {
+      fprintf(source, "struct Record%zu%s", r, sorted ? "Sorted" : "");
+      if (ri->firstField)
+        fprintf(source, " : Base%zu", r);
+      fprintf(source, "\n{\n");
+      if (!sorted)
+        for (size_t i = ri->firstField; i < ri->fieldCount; i++)
+          writeFieldDecl(source, ri->fields[i]);
+      else
+        for (size_t align = 128; align >= 8; align /= 2)
+          for (size_t i = ri->firstField; i < ri->fieldCount; i++)
+            if (ri->fields[i]->align == align)
+              writeFieldDecl(source, ri->fields[i]);
+      fprintf(source, "};\n\n");
+    }
+  }
+  fprintf(source, "int main()\n{\n");
+  for (size_t r = 0; r < recordCount; r++)
+    fprintf(source, "  printf(\"%%zu %%zu\\n\", sizeof(Record%zu), sizeof(Record%zuSorted));\n", r, r);
+  fprintf(source, "  return 0;\n}\n");
+  fclose(source);
+
+  size_t mismatches = 0;
+  char* command = concat(cxx, " -std=c++11 -o ", binaryName, " ", sourceName, NULL);
+  FILE* output = 0;
+  if (system(command) != 0 || !(output = popen(binaryName, "r")))
+    printf("Can't build records with %s, compiler check skipped\n", cxx);
+  else
+  {
+    size_t inexact = 0;
+    for (size_t r = 0; r < recordCount; r++)
+    {
+      size_t size;
+      size_t sortedSize;
+      if (fscanf(output, "%zu %zu", &size, &sortedSize) != 2)
+      {
+        printf("Unexpected output of compiled records\n");
+        mismatches++;
+        break;
+      }
+
+      const struct RecordInfo* ri = records[r];
+      const size_t layoutSize = layoutFieldsSize(ri, ri->fields);
+      if (size * 8 != ri->size || size * 8 != layoutSize || ri->estMinSize > sortedSize * 8)
+      {
+        printf("Mismatch: compiler gives %zu byte(s) (%zu byte(s) sorted), declaration order layout %zu byte(s), "
+          "estimation %zu byte(s)\n", size, sortedSize, layoutSize / 8, ri->estMinSize / 8);
+        printRecordInfo(stdout, ri, true);
+        mismatches++;
+      }
+      else if (ri->estMinSize < sortedSize * 8)
+        inexact++;
+    }
+    pclose(output);
+    printf("Compiler check: %zu record(s), %zu mismatch(es), %zu estimated below sorted layout size\n",
+      recordCount, mismatches, inexact);
+  }
+
+  for (size_t r = 0; r < recordCount; r++)
+    deleteRecordInfo(records[r]);
+  free(records);
+  unlink(binaryName);
+  unlink(sourceName);
+  rmdir(dirName);
+  free(command);
+  free(binaryName);
+  free(sourceName);
+  return mismatches;
+}
+
+static size_t solveEstimate(struct RecordInfo* ri)
+{
+  estimateMinRecordSize(ri);
+  return ri->estMinSize;
+}
+
+static size_t solveDeclarationOrder(struct RecordInfo* ri)
+{
+  return layoutFieldsSize(ri, ri->fields);
+}
+
+// Layout solvers to be timed, new ones go here
+static const struct Solver solvers[] =
+{
+  { "estimateMinRecordSize", solveEstimate },
+  { "layoutFieldsSize", solveDeclarationOrder }
+};
+
+static void timeSolvers()
+{
+  const size_t fieldCounts[] = { 10, 100, 1000 };
+  for (size_t c = 0; c < sizeof(fieldCounts) / sizeof(fieldCounts[0]); c++)
+  {
+    // Keep total number of fields same for each record size
+    const size_t recordCount = 100000 / fieldCounts[c];
+    struct RecordInfo** records = (struct RecordInfo**)xmalloc(recordCount * sizeof(struct RecordInfo*));
+    for (size_t r = 0; r < recordCount; r++)
+      records[r] = generateRecord(fieldCounts[c], randomRange(4) == 0);
+
+    for (size_t s = 0; s < sizeof(solvers) / sizeof(solvers[0]); s++)
+    {
+      struct timespec start;
+      struct timespec end;
+      size_t checksum = 0;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t r = 0; r < recordCount; r++)
+        checksum += solvers[s].solve(records[r]);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+
+      const double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+      printf("Timing: %s, %zu field(s): %.0f ns per record (checksum %zu)\n", solvers[s].name, fieldCounts[c],
+        ns / recordCount, checksum);
+    }
+
+    for (size_t r = 0; r < recordCount; r++)
+      deleteRecordInfo(records[r]);
+    free(records);
+  }
+}
+
+void usage(const char* progName)
+{
+  printf("Usage: %s [seed=N] [records=N] [cxx=compiler] [skip=ct] [strict]\n", progName);
+}
+
+int main(int argc, char** argv)
+{
+  size_t recordCount = 1000;
+  const char* cxx = "g++";
+  bool skipCompiler = false;
+  bool skipTiming = false;
+  bool strict = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strstr(argv[i], "seed=") == argv[i])
+      rngState = strtoull(argv[i] + 5, 0, 10) | 1;
+    else if (strstr(argv[i], "records=") == argv[i])
+      recordCount = strtoul(argv[i] + 8, 0, 10);
+    else if (strstr(argv[i], "cxx=") == argv[i])
+      cxx = argv[i] + 4;
+    else if (strstr(argv[i], "skip=") == argv[i])
+    {
+      skipCompiler = strchr(argv[i] + 5, 'c') != 0;
+      skipTiming = strchr(argv[i] + 5, 't') != 0;
+    }
+    else if (strcmp(argv[i], "strict") == 0)
+      strict = true;
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  size_t failures = checkBruteForce(recordCount, strict);
+  if (!skipCompiler)
+    failures += checkCompiler(cxx, recordCount < 200 ? recordCount : 200);
+  if (!skipTiming)
+    timeSolvers();
+
+  return failures ? 2 : 0;
+}
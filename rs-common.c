@@ -2,14 +2,20 @@
 
 #define HAVE_DECL_BASENAME 1
 #include <libiberty.h>
+#include <hashtab.h>
 #undef HAVE_DECL_BASENAME
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
 void deleteFieldInfo(struct FieldInfo* fi)
 {
   free(fi->name);
+  free(fi->typeName);
   free(fi);
 }
 
@@ -17,6 +23,7 @@ void deleteRecordInfo(struct RecordInfo* ri)
 {
   free(ri->name);
   free(ri->fileName);
+  free(ri->templateName);
 
   for (size_t i = 0; i < ri->fieldCount; i++)
     deleteFieldInfo(ri->fields[i]);
@@ -54,15 +61,50 @@ struct FieldInfo* loadFieldInfo(FILE* file)
   // Read field align
   if (fread(&fi->align, sizeof(fi->align), 1, file) != 1)
     goto out_name;
+  // Read field natural align
+  if (fread(&fi->naturalAlign, sizeof(fi->naturalAlign), 1, file) != 1)
+    goto out_name;
   // Read whether field is base/vptr
   if (fread(&fi->isSpecial, sizeof(fi->isSpecial), 1, file) != 1)
     goto out_name;
   // Read where field is bit-field
   if (fread(&fi->isBitField, sizeof(fi->isBitField), 1, file) != 1)
     goto out_name;
+  // Read embedded record type name length
+  if (fread(&len, sizeof(len), 1, file) != 1)
+    goto out_name;
+  fi->typeName = (char*)xmalloc(len + 1);
+  // Read embedded record type name
+  if (fread(fi->typeName, len + 1, 1, file) != 1 || fi->typeName[len] != 0)
+    goto out_typeName;
+  // Read narrowed enum size
+  if (fread(&fi->enumSize, sizeof(fi->enumSize), 1, file) != 1)
+    goto out_typeName;
+  // Read narrowed enum align
+  if (fread(&fi->enumAlign, sizeof(fi->enumAlign), 1, file) != 1)
+    goto out_typeName;
+  // Read whether field is bool
+  if (fread(&fi->isBool, sizeof(fi->isBool), 1, file) != 1)
+    goto out_typeName;
+  // Read whether field type is empty class
+  if (fread(&fi->isEmpty, sizeof(fi->isEmpty), 1, file) != 1)
+    goto out_typeName;
+  // Read compressed pointer size
+  if (fread(&fi->pointerSize, sizeof(fi->pointerSize), 1, file) != 1)
+    goto out_typeName;
+  // Read compressed pointer align
+  if (fread(&fi->pointerAlign, sizeof(fi->pointerAlign), 1, file) != 1)
+    goto out_typeName;
+  // Read flattened wrapper parts
+  if (fread(&fi->flatCount, sizeof(fi->flatCount), 1, file) != 1 || fi->flatCount > MAX_FLAT_MEMBERS)
+    goto out_typeName;
+  if (fi->flatCount && fread(fi->flatMembers, sizeof(struct FlatMember), fi->flatCount, file) != fi->flatCount)
+    goto out_typeName;
 
   return fi;
 
+out_typeName:
+  free(fi->typeName);
 out_name:
   free(fi->name);
 out_fi:
@@ -97,33 +139,69 @@ struct RecordInfo* loadRecordInfo(FILE* file)
   // Read source file name
   if (fread(ri->fileName, len + 1, 1, file) != 1 || ri->fileName[len] != 0)
     goto out_fileName;
+  // Read primary template name length
+  if (fread(&len, sizeof(len), 1, file) != 1)
+    goto out_fileName;
+  ri->templateName = (char*)xmalloc(len + 1);
+  // Read primary template name
+  if (fread(ri->templateName, len + 1, 1, file) != 1 || ri->templateName[len] != 0)
+    goto out_templateName;
   // Read source line
   if (fread(&ri->line, sizeof(ri->line), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
   // Read record size
   if (fread(&ri->size, sizeof(ri->size), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
   // Read record align
   if (fread(&ri->align, sizeof(ri->align), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
+  // Read record natural align
+  if (fread(&ri->naturalAlign, sizeof(ri->naturalAlign), 1, file) != 1)
+    goto out_templateName;
   // Read first non-base/vptr field index
   if (fread(&ri->firstField, sizeof(ri->firstField), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
   // Read estimated minimal size
   if (fread(&ri->estMinSize, sizeof(ri->estMinSize), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
+  // Read estimated minimal size with narrowed enums
+  if (fread(&ri->estEnumMinSize, sizeof(ri->estEnumMinSize), 1, file) != 1)
+    goto out_templateName;
+  // Read estimated minimal size with packed bools
+  if (fread(&ri->estBoolMinSize, sizeof(ri->estBoolMinSize), 1, file) != 1)
+    goto out_templateName;
+  // Read estimated minimal size without empty members
+  if (fread(&ri->estEmptyMinSize, sizeof(ri->estEmptyMinSize), 1, file) != 1)
+    goto out_templateName;
+  // Read estimated minimal size with compressed pointers
+  if (fread(&ri->estPointerMinSize, sizeof(ri->estPointerMinSize), 1, file) != 1)
+    goto out_templateName;
+  // Read estimated minimal size with flattened wrappers
+  if (fread(&ri->estFlatMinSize, sizeof(ri->estFlatMinSize), 1, file) != 1)
+    goto out_templateName;
+  // Read size with natural alignments
+  if (fread(&ri->naturalSize, sizeof(ri->naturalSize), 1, file) != 1)
+    goto out_templateName;
   // Read whether record contains bit-fields
   if (fread(&ri->hasBitFields, sizeof(ri->hasBitFields), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
   // Read whether record is template instance
   if (fread(&ri->isInstance, sizeof(ri->isInstance), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
   // Read whether record has virtual base(s)
   if (fread(&ri->hasVirtualBase, sizeof(ri->hasVirtualBase), 1, file) != 1)
-    goto out_fileName;
+    goto out_templateName;
+  // Read whether record is union
+  if (fread(&ri->isUnion, sizeof(ri->isUnion), 1, file) != 1)
+    goto out_templateName;
+  // Read number of instances in static storage
+  if (fread(&ri->staticCount, sizeof(ri->staticCount), 1, file) != 1)
+    goto out_templateName;
 
   return ri;
 
+out_templateName:
+  free(ri->templateName);
 out_fileName:
   free(ri->fileName);
 out_name:
@@ -138,35 +216,428 @@ out_ri:
   return 0;
 }
 
+static hashval_t hashStoredRecord(const void* p)
+{
+  return htab_hash_string(((const struct RecordInfo*)p)->name);
+}
+
+static int eqStoredRecordName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct RecordInfo*)p1)->name, (const char*)p2) == 0;
+}
+
+// Each block starts with magic and format version, bump version whenever
+// record serialization changes
+static const uint32_t dumpMagic = 0x4d445352; // 'RSDM'
+static const uint32_t dumpVersion = 1;
+static const char* loadError = "";
+
+const char* dumpLoadError()
+{
+  return loadError;
+}
+
+// Read block header and record count. Returns false at end of file (with empty
+// error) or on error.
+static bool loadBlockHeader(FILE* file, size_t* count)
+{
+  uint32_t header[2];
+  const size_t headerRead = fread(header, 1, sizeof(header), file);
+  if (headerRead != sizeof(header))
+  {
+    loadError = ferror(file) ? "I/O error" : (headerRead ? "truncated block" : "");
+    return false;
+  }
+  if (header[0] != dumpMagic)
+  {
+    loadError = "not a RecordSize dump or dump of older RecordSize version, remove it";
+    return false;
+  }
+  if (header[1] != dumpVersion)
+  {
+    loadError = "dump of different RecordSize version, remove it";
+    return false;
+  }
+  if (fread(count, sizeof(*count), 1, file) != 1)
+  {
+    loadError = ferror(file) ? "I/O error" : "truncated block";
+    return false;
+  }
+  return true;
+}
+
+static long dumpFileSize(FILE* file)
+{
+  struct stat fileStat;
+  return fstat(fileno(file), &fileStat) == 0 ? fileStat.st_size : -1;
+}
+
 struct RecordStorage* loadRecordStorage(FILE* file)
 {
   struct RecordStorage* rs = (struct RecordStorage*) xcalloc(1, sizeof(struct RecordStorage));
+  htab_t recordTable = htab_create(1024, hashStoredRecord, eqStoredRecordName, 0);
+  const long fileSize = dumpFileSize(file);
 
-  // Read record count
-  if (fread(&rs->recordCount, sizeof(rs->recordCount), 1, file) != 1)
-    goto out_rs;
-  rs->recordCapacity = rs->recordCount;
-  rs->records = (struct RecordInfo**)xcalloc(rs->recordCount, sizeof(struct RecordInfo*));
-  for (size_t i = 0; i < rs->recordCount; i++)
-    if ((rs->records[i] = loadRecordInfo(file)) == 0)
+  for (;;)
+  {
+    // Read block header, end of file means we've read all blocks
+    size_t count;
+    if (!loadBlockHeader(file, &count))
+    {
+      if (!*loadError)
+        break;
       goto out_records;
+    }
+    // Skip index, record data size and read records. Seeking past end of file
+    // succeeds, so check block size against file size.
+    size_t dataSize;
+    if (fseek(file, count * sizeof(uint64_t), SEEK_CUR) != 0 || fread(&dataSize, sizeof(dataSize), 1, file) != 1 ||
+      dataSize > (size_t)(fileSize - ftell(file)))
+    {
+      loadError = ferror(file) ? "I/O error" : "truncated block";
+      goto out_records;
+    }
+    const long dataEnd = ftell(file) + dataSize;
+    for (size_t i = 0; i < count; i++)
+    {
+      struct RecordInfo* ri = loadRecordInfo(file);
+      if (!ri)
+      {
+        loadError = ferror(file) ? "I/O error" : "invalid record data";
+        goto out_records;
+      }
+
+      void** slot = htab_find_slot_with_hash(recordTable, ri->name, htab_hash_string(ri->name), INSERT);
+      if (*slot)
+      {
+        ((struct RecordInfo*)*slot)->staticCount += ri->staticCount;
+        deleteRecordInfo(ri);
+      }
+      else
+      {
+        *slot = ri;
+        appendRecordInfo(rs, ri);
+      }
+    }
+    if (ftell(file) != dataEnd)
+    {
+      loadError = "invalid record data";
+      goto out_records;
+    }
+  }
 
+  htab_delete(recordTable);
   return rs;
 
 out_records:
+  htab_delete(recordTable);
   for (size_t i = 0; i < rs->recordCount; i++)
-    if (rs->records[i])
-      deleteRecordInfo(rs->records[i]);
+    deleteRecordInfo(rs->records[i]);
   free(rs->records);
-out_rs:
   free(rs);
   return 0;
 }
 
+FILE* openDumpFile(const char* name)
+{
+  for (;;)
+  {
+    FILE* file = fopen(name, "a+");
+    if (!file)
+      return 0;
+
+    struct stat fileStat;
+    if (flock(fileno(file), LOCK_EX) != 0 || fstat(fileno(file), &fileStat) != 0)
+    {
+      const int error = errno;
+      fclose(file);
+      errno = error;
+      return 0;
+    }
+
+    // rs-dwarf could replace dump while we were waiting for lock
+    struct stat nameStat;
+    if (stat(name, &nameStat) == 0 && nameStat.st_dev == fileStat.st_dev && nameStat.st_ino == fileStat.st_ino)
+      return file;
+    fclose(file);
+  }
+}
+
+uint64_t hashRecordName(const char* name)
+{
+  // FNV-1a, 64 bits make collisions between record names unlikely
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char* c = (const unsigned char*)name; *c; c++)
+    hash = (hash ^ *c) * 1099511628211ULL;
+  return hash;
+}
+
+char* templateFamilyName(const char* name)
+{
+  const char* argsStart = 0;
+  int depth = 0;
+  for (const char* c = name; *c; c++)
+  {
+    if (*c == '<' && depth++ == 0)
+      argsStart = c;
+    else if (*c == '>' && depth > 0)
+      depth--;
+  }
+
+  if (!argsStart)
+    return xstrdup(name);
+
+  char* family = (char*)xmalloc(argsStart - name + 1);
+  memcpy(family, name, argsStart - name);
+  family[argsStart - name] = 0;
+  return family;
+}
+
+static int compareHashes(const void* p1, const void* p2)
+{
+  const uint64_t h1 = *(const uint64_t*)p1;
+  const uint64_t h2 = *(const uint64_t*)p2;
+  return h1 < h2 ? -1 : h1 > h2;
+}
+
+struct RecordIndex* loadRecordIndex(FILE* file)
+{
+  struct RecordIndex* index = (struct RecordIndex*)xcalloc(1, sizeof(struct RecordIndex));
+  size_t hashCapacity = 0;
+  const long fileSize = dumpFileSize(file);
+
+  for (;;)
+  {
+    // Read block header, end of file means we've read all blocks
+    size_t count;
+    if (!loadBlockHeader(file, &count))
+    {
+      if (!*loadError)
+        break;
+      goto out_index;
+    }
+    if (index->hashCount + count > hashCapacity)
+    {
+      hashCapacity = (index->hashCount + count) * 2;
+      index->hashes = (uint64_t*)xrealloc(index->hashes, hashCapacity * sizeof(uint64_t));
+    }
+    // Read index and skip record data. Seeking past end of file succeeds, so
+    // check block size against file size.
+    size_t dataSize;
+    if ((count && fread(index->hashes + index->hashCount, sizeof(uint64_t), count, file) != count) ||
+      fread(&dataSize, sizeof(dataSize), 1, file) != 1 || dataSize > (size_t)(fileSize - ftell(file)) ||
+      fseek(file, dataSize, SEEK_CUR) != 0)
+    {
+      loadError = ferror(file) ? "I/O error" : "truncated block";
+      goto out_index;
+    }
+    index->hashCount += count;
+  }
+
+  qsort(index->hashes, index->hashCount, sizeof(uint64_t), compareHashes);
+  return index;
+
+out_index:
+  deleteRecordIndex(index);
+  return 0;
+}
+
+bool isRecordIndexed(const struct RecordIndex* index, const char* name)
+{
+  const uint64_t hash = hashRecordName(name);
+  return index->hashCount && bsearch(&hash, index->hashes, index->hashCount, sizeof(uint64_t), compareHashes);
+}
+
+void deleteRecordIndex(struct RecordIndex* index)
+{
+  free(index->hashes);
+  free(index);
+}
+
+struct RecordStorage* createRecordStorage()
+{
+  struct RecordStorage* rs = (struct RecordStorage*)xmalloc(sizeof(struct RecordStorage));
+  rs->recordCount = 0;
+  rs->recordCapacity = 256;
+  rs->records = (struct RecordInfo**)xmalloc(rs->recordCapacity * sizeof(struct RecordInfo*));
+
+  return rs;
+}
+
+void appendRecordInfo(struct RecordStorage* rs, struct RecordInfo* ri)
+{
+  rs->recordCount++;
+  if (rs->recordCount > rs->recordCapacity)
+  {
+    rs->recordCapacity = rs->recordCapacity ? rs->recordCapacity * 2 : 256;
+    rs->records = (struct RecordInfo**)xrealloc(rs->records, rs->recordCapacity * sizeof(struct RecordInfo*));
+  }
+
+  rs->records[rs->recordCount - 1] = ri;
+}
+
+void saveFieldInfo(FILE* file, const struct FieldInfo* fi)
+{
+  size_t len = strlen(fi->name);
+  fwrite(&len, sizeof(len), 1, file);
+  fwrite(fi->name, len + 1, 1, file);
+
+  fwrite(&fi->size, sizeof(fi->size), 1, file);
+  fwrite(&fi->offset, sizeof(fi->offset), 1, file);
+  fwrite(&fi->align, sizeof(fi->align), 1, file);
+  fwrite(&fi->naturalAlign, sizeof(fi->naturalAlign), 1, file);
+
+  fwrite(&fi->isSpecial, sizeof(fi->isSpecial), 1, file);
+  fwrite(&fi->isBitField, sizeof(fi->isBitField), 1, file);
+
+  len = strlen(fi->typeName);
+  fwrite(&len, sizeof(len), 1, file);
+  fwrite(fi->typeName, len + 1, 1, file);
+
+  fwrite(&fi->enumSize, sizeof(fi->enumSize), 1, file);
+  fwrite(&fi->enumAlign, sizeof(fi->enumAlign), 1, file);
+  fwrite(&fi->isBool, sizeof(fi->isBool), 1, file);
+  fwrite(&fi->isEmpty, sizeof(fi->isEmpty), 1, file);
+  fwrite(&fi->pointerSize, sizeof(fi->pointerSize), 1, file);
+  fwrite(&fi->pointerAlign, sizeof(fi->pointerAlign), 1, file);
+  fwrite(&fi->flatCount, sizeof(fi->flatCount), 1, file);
+  fwrite(fi->flatMembers, sizeof(struct FlatMember), fi->flatCount, file);
+}
+
+void saveRecordInfo(FILE* file, const struct RecordInfo* ri)
+{
+  fwrite(&ri->fieldCount, sizeof(ri->fieldCount), 1, file);
+  for (size_t i = 0; i < ri->fieldCount; i++)
+    saveFieldInfo(file, ri->fields[i]);
+
+  size_t len = strlen(ri->name);
+  fwrite(&len, sizeof(len), 1, file);
+  fwrite(ri->name, len + 1, 1, file);
+
+  len = strlen(ri->fileName);
+  fwrite(&len, sizeof(len), 1, file);
+  fwrite(ri->fileName, len + 1, 1, file);
+
+  len = strlen(ri->templateName);
+  fwrite(&len, sizeof(len), 1, file);
+  fwrite(ri->templateName, len + 1, 1, file);
+
+  fwrite(&ri->line, sizeof(ri->line), 1, file);
+  fwrite(&ri->size, sizeof(ri->size), 1, file);
+  fwrite(&ri->align, sizeof(ri->align), 1, file);
+  fwrite(&ri->naturalAlign, sizeof(ri->naturalAlign), 1, file);
+
+  fwrite(&ri->firstField, sizeof(ri->firstField), 1, file);
+
+  fwrite(&ri->estMinSize, sizeof(ri->estMinSize), 1, file);
+  fwrite(&ri->estEnumMinSize, sizeof(ri->estEnumMinSize), 1, file);
+  fwrite(&ri->estBoolMinSize, sizeof(ri->estBoolMinSize), 1, file);
+  fwrite(&ri->estEmptyMinSize, sizeof(ri->estEmptyMinSize), 1, file);
+  fwrite(&ri->estPointerMinSize, sizeof(ri->estPointerMinSize), 1, file);
+  fwrite(&ri->estFlatMinSize, sizeof(ri->estFlatMinSize), 1, file);
+  fwrite(&ri->naturalSize, sizeof(ri->naturalSize), 1, file);
+
+  fwrite(&ri->hasBitFields, sizeof(ri->hasBitFields), 1, file);
+  fwrite(&ri->isInstance, sizeof(ri->isInstance), 1, file);
+  fwrite(&ri->hasVirtualBase, sizeof(ri->hasVirtualBase), 1, file);
+  fwrite(&ri->isUnion, sizeof(ri->isUnion), 1, file);
+
+  fwrite(&ri->staticCount, sizeof(ri->staticCount), 1, file);
+}
+
+void saveRecordStorage(FILE* file, const struct RecordStorage* rs)
+{
+  if (rs->recordCount == 0)
+    return;
+
+  // Record data size is written before data, so serialize it to memory first
+  char* data = 0;
+  size_t dataSize = 0;
+  FILE* dataFile = open_memstream(&data, &dataSize);
+  for (size_t i = 0; i < rs->recordCount; i++)
+    saveRecordInfo(dataFile, rs->records[i]);
+  fclose(dataFile);
+
+  const uint32_t header[2] = {dumpMagic, dumpVersion};
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(&rs->recordCount, sizeof(rs->recordCount), 1, file);
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    const uint64_t hash = hashRecordName(rs->records[i]->name);
+    fwrite(&hash, sizeof(hash), 1, file);
+  }
+  fwrite(&dataSize, sizeof(dataSize), 1, file);
+  fwrite(data, 1, dataSize, file);
+  free(data);
+}
+
+// Print bit quantity as bytes, with bits after dot if needed
+static void printBits(FILE* file, int width, size_t bits)
+{
+  if (bits % 8)
+    fprintf(file, "%*zu.%zu", width > 2 ? width - 2 : 0, bits / 8, bits % 8);
+  else
+    fprintf(file, "%*zu", width, bits / 8);
+}
+
+static void printHole(FILE* file, const int* colWidths, const char* name, size_t offset, size_t size)
+{
+  fprintf(file, "%*s|%-*s|", colWidths[0], "", colWidths[1], name);
+  printBits(file, colWidths[2], offset);
+  fprintf(file, "|");
+  printBits(file, colWidths[3], size);
+  fprintf(file, "|\n");
+}
+
+void measurePadding(const struct RecordInfo* ri, size_t* totalPadding, size_t* maxHole)
+{
+  *totalPadding = 0;
+  *maxHole = 0;
+  // Empty record takes one byte, but it isn't padding we can reclaim
+  if (ri->fieldCount == 0)
+    return;
+
+  size_t end = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    const struct FieldInfo* fi = ri->fields[i];
+    if (fi->offset > end)
+    {
+      const size_t hole = fi->offset - end;
+      *totalPadding += hole;
+      if (hole > *maxHole)
+        *maxHole = hole;
+    }
+    if (fi->offset + fi->size > end)
+      end = fi->offset + fi->size;
+  }
+
+  if (ri->size > end)
+    *totalPadding += ri->size - end;
+}
+
+bool findLargestMembers(const struct RecordInfo* ri, size_t* largest, size_t* secondLargest)
+{
+  *largest = SIZE_MAX;
+  *secondLargest = SIZE_MAX;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    const size_t size = ri->fields[i]->size;
+    if (*largest == SIZE_MAX || size > ri->fields[*largest]->size)
+    {
+      *secondLargest = *largest;
+      *largest = i;
+    }
+    else if (*secondLargest == SIZE_MAX || size > ri->fields[*secondLargest]->size)
+      *secondLargest = i;
+  }
+  return *largest != SIZE_MAX;
+}
+
 void printRecordInfo(FILE* file, const struct RecordInfo* ri, bool printLayout)
 {
-  char recordFlags[6] = "\0";
-  if (ri->hasBitFields || ri->isInstance || ri->hasVirtualBase)
+  char recordFlags[8] = "\0";
+  if (ri->hasBitFields || ri->isInstance || ri->hasVirtualBase || ri->isUnion)
   {
     char* rf = recordFlags;
     *rf++ = '[';
@@ -176,6 +647,8 @@ void printRecordInfo(FILE* file, const struct RecordInfo* ri, bool printLayout)
       *rf++ = 'T';
     if (ri->hasVirtualBase)
       *rf++ = 'V';
+    if (ri->isUnion)
+      *rf++ = 'U';
     *rf++ = ']';
     *rf++ = ' ';
     *rf = 0;
@@ -187,6 +660,116 @@ void printRecordInfo(FILE* file, const struct RecordInfo* ri, bool printLayout)
   if (ri->estMinSize < ri->size)
     fprintf(file, "Warning: estimated minimal size is only %zu byte(s)\n", ri->estMinSize / 8);
 
+  if (ri->staticCount)
+  {
+    fprintf(file, "Note: %zu instance(s) in static storage take %zu byte(s)", ri->staticCount,
+      ri->staticCount * (ri->size / 8));
+    if (ri->estMinSize < ri->size)
+      fprintf(file, ", %zu byte(s) can be saved", ri->staticCount * ((ri->size - ri->estMinSize) / 8));
+    fprintf(file, "\n");
+  }
+
+  if (ri->allocSize)
+  {
+    fprintf(file, "Note: heap allocation takes %zu byte(s)", ri->allocSize / 8);
+    if (ri->estMinSize < ri->size)
+      fprintf(file, ", %zu byte(s) with estimated minimal size (%zu byte(s) saved per allocation)",
+        ri->allocMinSize / 8, (ri->allocSize - ri->allocMinSize) / 8);
+    fprintf(file, "\n");
+  }
+
+  if (ri->estMinSize < ri->size && ri->cascadeSaving > ri->size - ri->estMinSize)
+    fprintf(file, "Note: together with records embedding it %zu byte(s) can be saved\n", ri->cascadeSaving / 8);
+
+  const size_t reorderedSize = ri->estMinSize < ri->size ? ri->estMinSize : ri->size;
+  if (ri->estEnumMinSize < reorderedSize)
+  {
+    fprintf(file, "Note: with smaller enum underlying types (");
+    bool first = true;
+    for (size_t i = 0; i < ri->fieldCount; i++)
+    {
+      if (!ri->fields[i]->enumSize)
+        continue;
+      fprintf(file, "%s%s: %zu byte(s)", first ? "" : ", ", ri->fields[i]->name, ri->fields[i]->enumSize / 8);
+      first = false;
+    }
+    fprintf(file, ") estimated minimal size is %zu byte(s), %zu more byte(s) can be saved\n",
+      ri->estEnumMinSize / 8, (reorderedSize - ri->estEnumMinSize) / 8);
+  }
+
+  if (ri->estBoolMinSize < reorderedSize)
+    printPackedBoolsLayout(file, ri, reorderedSize);
+
+  if (ri->estEmptyMinSize < reorderedSize)
+  {
+    fprintf(file, "Note: with [[no_unique_address]] on empty member(s) (");
+    bool first = true;
+    for (size_t i = 0; i < ri->fieldCount; i++)
+    {
+      if (!ri->fields[i]->isEmpty)
+        continue;
+      fprintf(file, "%s%s", first ? "" : ", ", ri->fields[i]->name);
+      first = false;
+    }
+    fprintf(file, ") estimated minimal size is %zu byte(s), %zu more byte(s) can be saved\n",
+      ri->estEmptyMinSize / 8, (reorderedSize - ri->estEmptyMinSize) / 8);
+  }
+
+  if (ri->estPointerMinSize < reorderedSize)
+  {
+    fprintf(file, "Note: with %d-bit pointers (", COMPRESSED_POINTER_SIZE);
+    bool first = true;
+    for (size_t i = 0; i < ri->fieldCount; i++)
+    {
+      if (!ri->fields[i]->pointerSize)
+        continue;
+      fprintf(file, "%s%s", first ? "" : ", ", ri->fields[i]->name);
+      first = false;
+    }
+    fprintf(file, ") estimated minimal size is %zu byte(s), %zu more byte(s) can be saved\n",
+      ri->estPointerMinSize / 8, (reorderedSize - ri->estPointerMinSize) / 8);
+  }
+
+  if (ri->estFlatMinSize < reorderedSize)
+  {
+    fprintf(file, "Note: with flattened wrapper(s) (");
+    bool first = true;
+    for (size_t i = 0; i < ri->fieldCount; i++)
+    {
+      if (!ri->fields[i]->flatCount)
+        continue;
+      fprintf(file, "%s%s", first ? "" : ", ", ri->fields[i]->name);
+      first = false;
+    }
+    fprintf(file, ") estimated minimal size is %zu byte(s), %zu more byte(s) can be saved\n",
+      ri->estFlatMinSize / 8, (reorderedSize - ri->estFlatMinSize) / 8);
+  }
+
+  size_t largest;
+  size_t secondLargest;
+  if (ri->isUnion && findLargestMembers(ri, &largest, &secondLargest))
+  {
+    fprintf(file, "Note: largest union member %s takes %zu byte(s)", ri->fields[largest]->name,
+      ri->fields[largest]->size / 8);
+    if (secondLargest != SIZE_MAX)
+      fprintf(file, ", second largest %s takes %zu byte(s), gap %zu byte(s)", ri->fields[secondLargest]->name,
+        ri->fields[secondLargest]->size / 8, (ri->fields[largest]->size - ri->fields[secondLargest]->size) / 8);
+    fprintf(file, "\n");
+  }
+
+  if (ri->naturalSize < ri->size)
+  {
+    fprintf(file, "Note: over-alignment takes %zu byte(s) per object", (ri->size - ri->naturalSize) / 8);
+    if (ri->staticCount)
+      fprintf(file, ", %zu byte(s) in static storage", ri->staticCount * ((ri->size - ri->naturalSize) / 8));
+    fprintf(file, " (record align %zu byte(s), natural %zu byte(s)", ri->align / 8, ri->naturalAlign / 8);
+    for (size_t i = 0; i < ri->fieldCount; i++)
+      if (ri->fields[i]->naturalAlign < ri->fields[i]->align)
+        fprintf(file, "; %s align %zu byte(s), natural %zu byte(s)", ri->fields[i]->name, ri->fields[i]->align / 8,
+          ri->fields[i]->naturalAlign / 8);
+    fprintf(file, ")\n");
+  }
+
   if (!printLayout || ri->fieldCount == 0)
     return;
 
@@ -204,9 +787,16 @@ void printRecordInfo(FILE* file, const struct RecordInfo* ri, bool printLayout)
     colWidths[2], colNames[2], colWidths[3], colNames[3], colWidths[4], colNames[4], colWidths[5], colNames[5],
     colWidths[6], colNames[6]);
 
+  size_t end = 0;
   for (size_t i = 0; i < ri->fieldCount; i++)
   {
     struct FieldInfo* fi = ri->fields[i];
+    // Gap between fields (or within bit-field storage unit)
+    if (fi->offset > end)
+      printHole(file, colWidths, "<hole>", end, fi->offset - end);
+    if (fi->offset + fi->size > end)
+      end = fi->offset + fi->size;
+
     const size_t offset = fi->offset / 8;
     const size_t size = fi->size / 8 ;
     const size_t align = fi->align / 8;
@@ -223,5 +813,397 @@ void printRecordInfo(FILE* file, const struct RecordInfo* ri, bool printLayout)
         colWidths[6], fi->isBitField);
     }
   }
+  if (ri->size > end)
+    printHole(file, colWidths, "<tail padding>", end, ri->size - end);
+
+  size_t totalPadding;
+  size_t maxHole;
+  measurePadding(ri, &totalPadding, &maxHole);
+  fprintf(file, "Padding: total ");
+  printBits(file, 0, totalPadding);
+  fprintf(file, " byte(s), largest hole ");
+  printBits(file, 0, maxHole);
+  fprintf(file, " byte(s), tail ");
+  printBits(file, 0, ri->size > end ? ri->size - end : 0);
+  fprintf(file, " byte(s)\n");
+}
+
+static size_t alignUp(size_t value, size_t align)
+{
+  if (align && value % align)
+    value = (value / align + 1) * align;
+  return value;
+}
+
+static size_t endOfBases(const struct RecordInfo* ri, struct FieldInfo* const* fields)
+{
+  if (ri->firstField == 0)
+    return 0;
+
+  return fields[ri->firstField - 1]->offset + fields[ri->firstField - 1]->size;
+}
+
+static size_t estimateMinLayoutSize(const struct RecordInfo* ri, struct FieldInfo* const* fields,
+  size_t recordAlign)
+{
+  // At the moment we can't handle some cases
+  if (ri->hasBitFields || ri->hasVirtualBase)
+    return SIZE_MAX;
+
+  // Handle records with bases only
+  if (ri->firstField == SIZE_MAX)
+    return ri->size;
+
+  // Union members overlap, so only largest one matters
+  if (ri->isUnion)
+  {
+    size_t maxSize = 0;
+    for (size_t i = 0; i < ri->fieldCount; i++)
+      if (fields[i]->size > maxSize)
+        maxSize = fields[i]->size;
+    return alignUp(maxSize, recordAlign);
+  }
+
+  // We assume that field alignment is always power of two, so we can always reorder them
+  // to have record 'packed'
+  size_t fieldsSize = 0;
+  size_t maxFieldAlign = 0;
+  for (size_t i = ri->firstField; i < ri->fieldCount; i++)
+  {
+    fieldsSize += fields[i]->size;
+    if (fields[i]->align > maxFieldAlign)
+      maxFieldAlign = fields[i]->align;
+  }
+
+  // If we have bases there can be a need for additional padding between bases and first field
+  size_t minSize = alignUp(endOfBases(ri, fields), maxFieldAlign) + fieldsSize;
+  // Let us add final padding if needed
+  return alignUp(minSize, recordAlign);
+}
+
+size_t estimateMinFieldsSize(const struct RecordInfo* ri, struct FieldInfo* const* fields)
+{
+  return estimateMinLayoutSize(ri, fields, ri->align);
+}
+
+// Estimate minimal size with narrowed enums or compressed pointers
+static size_t estimateNarrowedMinSize(const struct RecordInfo* ri, bool pointers)
+{
+  bool hasNarrowed = false;
+  size_t maxAlign = 0;
+  size_t maxEnumAlign = 0;
+  struct FieldInfo* narrowed = (struct FieldInfo*)xmalloc(ri->fieldCount * sizeof(struct FieldInfo));
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    narrowed[i] = *ri->fields[i];
+    const size_t size = pointers ? narrowed[i].pointerSize : narrowed[i].enumSize;
+    if (size)
+    {
+      narrowed[i].size = size;
+      narrowed[i].align = pointers ? narrowed[i].pointerAlign : narrowed[i].enumAlign;
+      hasNarrowed = true;
+    }
+    if (ri->fields[i]->align > maxAlign)
+      maxAlign = ri->fields[i]->align;
+    if (narrowed[i].align > maxEnumAlign)
+      maxEnumAlign = narrowed[i].align;
+    fields[i] = &narrowed[i];
+  }
+
+  // Record alignment comes from its fields unless it is set by alignas()
+  size_t recordAlign = ri->align > maxAlign ? ri->align : maxEnumAlign;
+  size_t minSize = hasNarrowed ? estimateMinLayoutSize(ri, fields, recordAlign) : SIZE_MAX;
+
+  free(fields);
+  free(narrowed);
+  return minSize;
+}
+
+// Replace bool fields with single flag word placed after other fields.
+// Returns number of fields in new list.
+static size_t packBoolFields(const struct RecordInfo* ri, struct FieldInfo** fields, struct FieldInfo* flags)
+{
+  size_t count = 0;
+  size_t boolCount = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+    if (i >= ri->firstField && ri->fields[i]->isBool)
+      boolCount++;
+    else
+      fields[count++] = ri->fields[i];
+
+  memset(flags, 0, sizeof(*flags));
+  flags->name = (char*)"flags";
+  flags->typeName = (char*)"";
+  flags->size = alignUp(boolCount, 8);
+  flags->align = 8;
+  fields[count++] = flags;
+  return count;
+}
+
+static size_t estimatePackedBoolsSize(const struct RecordInfo* ri)
+{
+  size_t boolCount = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+    if (ri->fields[i]->isBool)
+      boolCount++;
+  // Single bool can't be packed, union bools already share storage
+  if (boolCount < 2 || ri->isUnion)
+    return SIZE_MAX;
+
+  struct FieldInfo flags;
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  struct RecordInfo packed = *ri;
+  packed.fields = fields;
+  packed.fieldCount = packBoolFields(ri, fields, &flags);
+  size_t minSize = estimateMinFieldsSize(&packed, fields);
+
+  free(fields);
+  return minSize;
+}
+
+static size_t estimateNoEmptySize(const struct RecordInfo* ri)
+{
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  struct RecordInfo stripped = *ri;
+  stripped.fields = fields;
+  stripped.fieldCount = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+    if (i < ri->firstField || !ri->fields[i]->isEmpty)
+      fields[stripped.fieldCount++] = ri->fields[i];
+
+  size_t minSize = SIZE_MAX;
+  if (stripped.fieldCount < ri->fieldCount)
+  {
+    // Record without other fields still takes at least its size with bases,
+    // like empty base does
+    if (stripped.fieldCount == ri->firstField)
+      stripped.firstField = SIZE_MAX;
+    minSize = estimateMinFieldsSize(&stripped, fields);
+    if (stripped.firstField == SIZE_MAX && minSize != SIZE_MAX)
+      minSize = ri->firstField ? alignUp(endOfBases(ri, ri->fields), ri->align) : ri->align;
+  }
+
+  free(fields);
+  return minSize;
+}
+
+// Replace wrapper fields by their parts, so engaged flag or variant index can
+// be placed into padding of record
+static size_t estimateFlatMinSize(const struct RecordInfo* ri)
+{
+  size_t partCount = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+    partCount += ri->fields[i]->flatCount;
+  // Union members already share storage
+  if (!partCount || ri->isUnion)
+    return SIZE_MAX;
+
+  struct FieldInfo* parts = (struct FieldInfo*)xmalloc(partCount * sizeof(struct FieldInfo));
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc((ri->fieldCount + partCount) * sizeof(struct FieldInfo*));
+  struct RecordInfo flat = *ri;
+  flat.fields = fields;
+  flat.fieldCount = 0;
+  size_t partIndex = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    if (!ri->fields[i]->flatCount)
+    {
+      fields[flat.fieldCount++] = ri->fields[i];
+      continue;
+    }
+    for (size_t j = 0; j < ri->fields[i]->flatCount; j++)
+    {
+      struct FieldInfo* part = &parts[partIndex++];
+      memset(part, 0, sizeof(*part));
+      part->name = ri->fields[i]->name;
+      part->typeName = (char*)"";
+      part->size = ri->fields[i]->flatMembers[j].size;
+      part->align = ri->fields[i]->flatMembers[j].align;
+      part->naturalAlign = part->align;
+      fields[flat.fieldCount++] = part;
+    }
+  }
+  size_t minSize = estimateMinFieldsSize(&flat, fields);
+
+  free(fields);
+  free(parts);
+  return minSize;
+}
+
+bool isWrapperType(const char* typeName)
+{
+  return strncmp(typeName, "std::optional<", 14) == 0 || strncmp(typeName, "std::pair<", 10) == 0 ||
+    strncmp(typeName, "std::variant<", 13) == 0;
+}
+
+void flattenWrapperField(struct FieldInfo* fi, const char* typeName, const size_t* sizes, const size_t* aligns,
+  size_t count)
+{
+  struct FlatMember members[MAX_FLAT_MEMBERS];
+  if (strncmp(typeName, "std::optional<", 14) == 0 && count >= 1)
+  {
+    // Value storage followed by engaged flag
+    members[0].size = sizes[0];
+    members[0].align = aligns[0];
+    members[1].size = 8;
+    members[1].align = 8;
+  }
+  else if (strncmp(typeName, "std::pair<", 10) == 0 && count >= 2)
+  {
+    members[0].size = sizes[0];
+    members[0].align = aligns[0];
+    members[1].size = sizes[1];
+    members[1].align = aligns[1];
+  }
+  else if (strncmp(typeName, "std::variant<", 13) == 0 && count >= 1)
+  {
+    // Union of alternatives followed by index of smallest sufficient type
+    members[0].size = 0;
+    members[0].align = 8;
+    for (size_t i = 0; i < count; i++)
+    {
+      if (sizes[i] > members[0].size)
+        members[0].size = sizes[i];
+      if (aligns[i] > members[0].align)
+        members[0].align = aligns[i];
+    }
+    members[0].size = alignUp(members[0].size, members[0].align);
+    members[1].size = count < 255 ? 8 : 16;
+    members[1].align = members[1].size;
+  }
+  else
+    return;
+
+  // Other library implementations may lay wrapper out differently, so keep
+  // parts only if they give wrapper size and alignment (over-aligned field
+  // can't be split too)
+  const size_t wrapperAlign = members[0].align > members[1].align ? members[0].align : members[1].align;
+  const size_t wrapperSize = alignUp(alignUp(members[0].size, members[1].align) + members[1].size, wrapperAlign);
+  if (wrapperSize != fi->size || wrapperAlign != fi->align || !members[0].size || !members[1].size)
+    return;
+
+  memcpy(fi->flatMembers, members, sizeof(members));
+  fi->flatCount = MAX_FLAT_MEMBERS;
+}
+
+size_t layoutNaturalSize(const struct RecordInfo* ri, const size_t* fieldSizes)
+{
+  bool isOverAligned = ri->naturalAlign < ri->align;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+    if (ri->fields[i]->naturalAlign < ri->fields[i]->align || (fieldSizes && fieldSizes[i] < ri->fields[i]->size))
+      isOverAligned = true;
+  if (!isOverAligned)
+    return ri->size;
+
+  struct FieldInfo* natural = (struct FieldInfo*)xmalloc(ri->fieldCount * sizeof(struct FieldInfo));
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    natural[i] = *ri->fields[i];
+    natural[i].align = natural[i].naturalAlign;
+    if (fieldSizes)
+      natural[i].size = fieldSizes[i];
+    fields[i] = &natural[i];
+  }
+  struct RecordInfo naturalRecord = *ri;
+  naturalRecord.fields = fields;
+  naturalRecord.align = ri->naturalAlign;
+  size_t size = layoutFieldsSize(&naturalRecord, fields);
+
+  free(fields);
+  free(natural);
+  return size;
+}
+
+void estimateMinRecordSize(struct RecordInfo* ri)
+{
+  ri->estMinSize = estimateMinFieldsSize(ri, ri->fields);
+  ri->estEnumMinSize = estimateNarrowedMinSize(ri, false);
+  ri->estBoolMinSize = estimatePackedBoolsSize(ri);
+  ri->estEmptyMinSize = estimateNoEmptySize(ri);
+  ri->estPointerMinSize = estimateNarrowedMinSize(ri, true);
+  ri->estFlatMinSize = estimateFlatMinSize(ri);
+  ri->naturalSize = layoutNaturalSize(ri, 0);
+}
+
+void printPackedBoolsLayout(FILE* file, const struct RecordInfo* ri, size_t reorderedSize)
+{
+  struct FieldInfo flags;
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  const size_t count = packBoolFields(ri, fields, &flags);
+
+  fprintf(file, "Note: with bool fields packed into %zu flag byte(s) estimated minimal size is %zu byte(s), "
+    "%zu more byte(s) can be saved\n", flags.size / 8, ri->estBoolMinSize / 8,
+    (reorderedSize - ri->estBoolMinSize) / 8);
+
+  // Place fields with biggest alignment first, flag word goes last among
+  // equally aligned ones
+  for (size_t i = ri->firstField + 1; i < count; i++)
+    for (size_t j = i; j > ri->firstField && fields[j - 1]->align < fields[j]->align; j--)
+    {
+      struct FieldInfo* fi = fields[j];
+      fields[j] = fields[j - 1];
+      fields[j - 1] = fi;
+    }
+
+  fprintf(file, "  Suggested layout:");
+  size_t offset = endOfBases(ri, fields);
+  for (size_t i = ri->firstField; i < count; i++)
+  {
+    offset = alignUp(offset, fields[i]->align);
+    if (fields[i] != &flags)
+      fprintf(file, " %s@%zu", fields[i]->name, offset / 8);
+    else
+    {
+      fprintf(file, " flags{");
+      bool first = true;
+      for (size_t j = ri->firstField; j < ri->fieldCount; j++)
+        if (ri->fields[j]->isBool)
+        {
+          fprintf(file, "%s%s", first ? "" : ",", ri->fields[j]->name);
+          first = false;
+        }
+      fprintf(file, "}@%zu", offset / 8);
+    }
+    offset += fields[i]->size;
+  }
+  fprintf(file, "\n");
+
+  free(fields);
+}
+
+size_t enumMinSize(int64_t minValue, uint64_t maxValue)
+{
+  // Negative enumerators require signed type, it holds -2^(N-1)..2^(N-1)-1
+  const uint64_t magnitude = minValue < 0 ? ~(uint64_t)minValue : 0;
+  const bool isSigned = minValue < 0;
+  size_t size = 8;
+  for (; size < 64; size *= 2)
+  {
+    const size_t valueBits = isSigned ? size - 1 : size;
+    if ((maxValue >> valueBits) == 0 && (magnitude >> valueBits) == 0)
+      break;
+  }
+  return size;
+}
+
+size_t layoutFieldsSize(const struct RecordInfo* ri, struct FieldInfo* const* fields)
+{
+  if (ri->hasBitFields || ri->hasVirtualBase)
+    return SIZE_MAX;
+
+  if (ri->firstField == SIZE_MAX)
+    return ri->size;
+
+  // Union layout doesn't depend on order
+  if (ri->isUnion)
+    return estimateMinFieldsSize(ri, fields);
+
+  // Place fields one after another in declaration order, just like compiler does
+  size_t offset = endOfBases(ri, fields);
+  for (size_t i = ri->firstField; i < ri->fieldCount; i++)
+    offset = alignUp(offset, fields[i]->align) + fields[i]->size;
 
+  return alignUp(offset, ri->align);
 }
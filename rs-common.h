@@ -3,6 +3,7 @@
 
 #include "rs-types.h"
 
+#include <stdint.h>
 #include <stdio.h>
 
 void deleteFieldInfo(struct FieldInfo* fi);
@@ -11,8 +12,71 @@ void deleteRecordStorage(struct RecordStorage* rs);
 
 struct FieldInfo* loadFieldInfo(FILE* file);
 struct RecordInfo* loadRecordInfo(FILE* file);
+// Load all blocks of dump. Records stored several times (to carry instance
+// counts from different translation units) are merged.
 struct RecordStorage* loadRecordStorage(FILE* file);
 
+// Open dump for appending (create it if needed) and lock it exclusively. Lock
+// is released when file is closed. Returns 0 and sets errno on failure.
+FILE* openDumpFile(const char* name);
+
+// Dump consists of blocks, each one is appended by single compiler (or
+// rs-dwarf) invocation: magic and format version, record count, name hashes of
+// records, size of record data and record data itself. Index allows to skip
+// record data.
+uint64_t hashRecordName(const char* name);
+struct RecordIndex* loadRecordIndex(FILE* file);
+// Reason of last loadRecordStorage() or loadRecordIndex() failure
+const char* dumpLoadError();
+bool isRecordIndexed(const struct RecordIndex* index, const char* name);
+void deleteRecordIndex(struct RecordIndex* index);
+
+// Strip template arguments of last name component, e.g. 'A<int>::B<char>'
+// gives 'A<int>::B'. Plugin and rs-dwarf name template families this way.
+char* templateFamilyName(const char* name);
+
+struct RecordStorage* createRecordStorage();
+void appendRecordInfo(struct RecordStorage* rs, struct RecordInfo* ri);
+
+void saveFieldInfo(FILE* file, const struct FieldInfo* ri);
+void saveRecordInfo(FILE* file, const struct RecordInfo* ri);
+// Write storage as single dump block
+void saveRecordStorage(FILE* file, const struct RecordStorage* rs);
+
 void printRecordInfo(FILE* file, const struct RecordInfo* ri, bool printLayout);
+// Find indices of largest and second largest fields (SIZE_MAX if there is no
+// such field). Returns false for record without fields.
+bool findLargestMembers(const struct RecordInfo* ri, size_t* largest, size_t* secondLargest);
+// Calculate total padding (holes between fields, within bit-field storage
+// units and tail padding) and largest hole between fields, in bits
+void measurePadding(const struct RecordInfo* ri, size_t* totalPadding, size_t* maxHole);
+
+// Estimate minimal size of record if its fields are replaced by given ones.
+// Returns SIZE_MAX if estimation isn't possible.
+size_t estimateMinFieldsSize(const struct RecordInfo* ri, struct FieldInfo* const* fields);
+// Estimate minimal sizes of record as is, with narrowed enums, with packed
+// bools, without empty members, with compressed pointers and with flattened
+// wrappers. Also calculate size with natural alignments.
+void estimateMinRecordSize(struct RecordInfo* ri);
+// Print estimation with packed bools and field order achieving it
+void printPackedBoolsLayout(FILE* file, const struct RecordInfo* ri, size_t reorderedSize);
+// Calculate size of record if its fields are replaced by given ones and laid
+// out in declaration order. Returns SIZE_MAX if layout isn't possible.
+size_t layoutFieldsSize(const struct RecordInfo* ri, struct FieldInfo* const* fields);
+// Calculate size of record in declaration order with natural alignments of
+// record and its fields. fieldSizes (if given) replace field sizes, so natural
+// sizes of embedded records can be taken into account.
+size_t layoutNaturalSize(const struct RecordInfo* ri, const size_t* fieldSizes);
+// Check whether record is std::optional, std::pair or std::variant, which
+// field can be flattened into containing record
+bool isWrapperType(const char* typeName);
+// Set parts of wrapper field given sizes and alignments of its template
+// arguments (variant alternatives). Field is left as is if parts don't
+// reproduce wrapper layout.
+void flattenWrapperField(struct FieldInfo* fi, const char* typeName, const size_t* sizes, const size_t* aligns,
+  size_t count);
+// Calculate size (in bits) of smallest integer type holding all enumerators
+// from minValue (zero if there are no negative ones) to maxValue
+size_t enumMinSize(int64_t minValue, uint64_t maxValue);
 
 #endif
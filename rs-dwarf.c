@@ -0,0 +1,1922 @@
+#include "rs-common.h"
+
+#define HAVE_DECL_BASENAME 1
+#include <libiberty.h>
+#include <hashtab.h>
+#undef HAVE_DECL_BASENAME
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// DWARF constants we need. We don't depend on libdwarf/libdw, so define them
+// here (see DWARF 5 standard, chapter 7).
+enum
+{
+  DW_TAG_array_type = 0x01,
+  DW_TAG_class_type = 0x02,
+  DW_TAG_enumeration_type = 0x04,
+  DW_TAG_member = 0x0d,
+  DW_TAG_pointer_type = 0x0f,
+  DW_TAG_reference_type = 0x10,
+  DW_TAG_compile_unit = 0x11,
+  DW_TAG_structure_type = 0x13,
+  DW_TAG_subroutine_type = 0x15,
+  DW_TAG_typedef = 0x16,
+  DW_TAG_variable = 0x34,
+  DW_TAG_union_type = 0x17,
+  DW_TAG_inheritance = 0x1c,
+  DW_TAG_subrange_type = 0x21,
+  DW_TAG_enumerator = 0x28,
+  DW_TAG_ptr_to_member_type = 0x1f,
+  DW_TAG_template_type_param = 0x2f,
+  DW_TAG_template_value_param = 0x30,
+  DW_TAG_base_type = 0x24,
+  DW_TAG_const_type = 0x26,
+  DW_TAG_volatile_type = 0x35,
+  DW_TAG_restrict_type = 0x37,
+  DW_TAG_namespace = 0x39,
+  DW_TAG_rvalue_reference_type = 0x42,
+  DW_TAG_partial_unit = 0x3c,
+  DW_TAG_atomic_type = 0x47,
+  DW_TAG_GNU_template_parameter_pack = 0x4107
+};
+
+enum
+{
+  DW_AT_location = 0x02,
+  DW_AT_name = 0x03,
+  DW_AT_byte_size = 0x0b,
+  DW_AT_bit_offset = 0x0c,
+  DW_AT_bit_size = 0x0d,
+  DW_AT_const_value = 0x1c,
+  DW_AT_stmt_list = 0x10,
+  DW_AT_upper_bound = 0x2f,
+  DW_AT_count = 0x37,
+  DW_AT_data_member_location = 0x38,
+  DW_AT_decl_file = 0x3a,
+  DW_AT_decl_line = 0x3b,
+  DW_AT_declaration = 0x3c,
+  DW_AT_encoding = 0x3e,
+  DW_AT_external = 0x3f,
+  DW_AT_specification = 0x47,
+  DW_AT_type = 0x49,
+  DW_AT_virtuality = 0x4c,
+  DW_AT_artificial = 0x34,
+  DW_AT_data_bit_offset = 0x6b,
+  DW_AT_str_offsets_base = 0x72,
+  DW_AT_linkage_name = 0x6e,
+  DW_AT_MIPS_linkage_name = 0x2007,
+  DW_AT_alignment = 0x88
+};
+
+enum
+{
+  DW_FORM_addr = 0x01,
+  DW_FORM_block2 = 0x03,
+  DW_FORM_block4 = 0x04,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_data8 = 0x07,
+  DW_FORM_string = 0x08,
+  DW_FORM_block = 0x09,
+  DW_FORM_block1 = 0x0a,
+  DW_FORM_data1 = 0x0b,
+  DW_FORM_flag = 0x0c,
+  DW_FORM_sdata = 0x0d,
+  DW_FORM_strp = 0x0e,
+  DW_FORM_udata = 0x0f,
+  DW_FORM_ref_addr = 0x10,
+  DW_FORM_ref1 = 0x11,
+  DW_FORM_ref2 = 0x12,
+  DW_FORM_ref4 = 0x13,
+  DW_FORM_ref8 = 0x14,
+  DW_FORM_ref_udata = 0x15,
+  DW_FORM_indirect = 0x16,
+  DW_FORM_sec_offset = 0x17,
+  DW_FORM_exprloc = 0x18,
+  DW_FORM_flag_present = 0x19,
+  DW_FORM_strx = 0x1a,
+  DW_FORM_addrx = 0x1b,
+  DW_FORM_ref_sup4 = 0x1c,
+  DW_FORM_strp_sup = 0x1d,
+  DW_FORM_data16 = 0x1e,
+  DW_FORM_line_strp = 0x1f,
+  DW_FORM_ref_sig8 = 0x20,
+  DW_FORM_implicit_const = 0x21,
+  DW_FORM_loclistx = 0x22,
+  DW_FORM_rnglistx = 0x23,
+  DW_FORM_ref_sup8 = 0x24,
+  DW_FORM_strx1 = 0x25,
+  DW_FORM_strx2 = 0x26,
+  DW_FORM_strx3 = 0x27,
+  DW_FORM_strx4 = 0x28,
+  DW_FORM_addrx1 = 0x29,
+  DW_FORM_addrx2 = 0x2a,
+  DW_FORM_addrx3 = 0x2b,
+  DW_FORM_addrx4 = 0x2c
+};
+
+enum
+{
+  DW_OP_addr = 0x03,
+  DW_OP_constu = 0x10,
+  DW_OP_plus_uconst = 0x23,
+  DW_ATE_boolean = 0x02,
+  DW_ATE_complex_float = 0x03,
+  DW_ATE_signed = 0x05,
+  DW_ATE_signed_char = 0x06,
+  DW_LNCT_path = 0x1,
+  DW_LNCT_directory_index = 0x2,
+  DW_UT_compile = 0x01,
+  DW_UT_partial = 0x03
+};
+
+#define NO_DIE SIZE_MAX
+
+struct DebugSection
+{
+  const uint8_t* data;
+  size_t size;
+};
+
+struct InputFile
+{
+  const char* path;
+  void* map;
+  size_t mapSize;
+  // Object file addresses are relative to sections
+  bool isRelocatable;
+  // Sections we've copied to apply relocations (object files only)
+  uint8_t* relocated[2];
+  struct DebugSection info;
+  struct DebugSection abbrev;
+  struct DebugSection str;
+  struct DebugSection lineStr;
+  struct DebugSection line;
+  struct DebugSection strOffsets;
+};
+
+// Compilation unit to process
+struct UnitRef
+{
+  struct InputFile* file;
+  size_t offset;
+};
+
+struct AbbrevAttr
+{
+  uint64_t name;
+  uint64_t form;
+  int64_t implicitConst;
+};
+
+struct Abbrev
+{
+  uint64_t tag;
+  bool hasChildren;
+  size_t attrCount;
+  struct AbbrevAttr* attrs;
+};
+
+struct Die
+{
+  // Offset within .debug_info
+  size_t offset;
+  uint64_t tag;
+  size_t parent;
+  size_t firstChild;
+  size_t nextSibling;
+  const char* name;
+  uint64_t byteSize;
+  uint64_t bitSize;
+  uint64_t bitOffset;
+  uint64_t dataBitOffset;
+  uint64_t memberLocation;
+  uint64_t type;
+  uint64_t specification;
+  uint64_t alignment;
+  uint64_t count;
+  uint64_t encoding;
+  uint64_t declFile;
+  uint64_t declLine;
+  uint64_t constValue;
+  // Size of fixed-size constant form, zero if value is already extended
+  int constSize;
+  bool hasByteSize;
+  bool hasBitSize;
+  bool hasBitOffset;
+  bool hasDataBitOffset;
+  bool hasMemberLocation;
+  bool hasCount;
+  bool isDeclaration;
+  bool isArtificial;
+  bool isVirtual;
+  bool hasLocation;
+  // Variable address given by DW_OP_addr location
+  uint64_t address;
+  bool hasAddress;
+  const char* linkageName;
+  bool isExternal;
+  // Parent chain consists only of namespaces and compilation unit
+  bool atNamespaceScope;
+};
+
+struct Unit
+{
+  struct InputFile* file;
+  size_t offset;
+  size_t end;
+  int version;
+  int offsetSize;
+  int addressSize;
+  uint64_t strOffsetsBase;
+  // Line table offset from unit DIE
+  uint64_t stmtList;
+  bool hasStmtList;
+  struct Abbrev* abbrevs;
+  size_t abbrevCount;
+  struct Die* dies;
+  size_t dieCount;
+  size_t dieCapacity;
+  // Calculated type alignments, zero if not yet known
+  uint64_t* aligns;
+  // Same without alignas()/aligned attributes
+  uint64_t* naturalAligns;
+  char** fileNames;
+  size_t fileNameCount;
+};
+
+struct AttrValue
+{
+  uint64_t value;
+  const char* string;
+  const uint8_t* block;
+  uint64_t blockSize;
+};
+
+// State shared between worker threads
+static struct UnitRef* units = 0;
+static size_t unitCount = 0;
+static size_t nextUnit = 0;
+static struct RecordStorage* storage = 0;
+// Processed records by name
+static htab_t recordTable = 0;
+// Record instances in static storage counted in this run
+static htab_t instanceTable = 0;
+// Keys of variable definitions already counted, see variableKey()
+static htab_t variableTable = 0;
+static pthread_mutex_t storageMutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct InstanceCount
+{
+  char* name;
+  size_t count;
+};
+
+hashval_t hashRecordInfo(const void* p)
+{
+  return htab_hash_string(((const struct RecordInfo*)p)->name);
+}
+
+int eqRecordInfoName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct RecordInfo*)p1)->name, (const char*)p2) == 0;
+}
+
+hashval_t hashInstanceCount(const void* p)
+{
+  return htab_hash_string(((const struct InstanceCount*)p)->name);
+}
+
+int eqInstanceCountName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct InstanceCount*)p1)->name, (const char*)p2) == 0;
+}
+
+void deleteInstanceCount(void* p)
+{
+  free(((struct InstanceCount*)p)->name);
+  free(p);
+}
+
+int eqVariableKey(const void* p1, const void* p2)
+{
+  return strcmp((const char*)p1, (const char*)p2) == 0;
+}
+
+// Replace dumped instance count by one counted in this run, so running
+// rs-dwarf again over same binaries doesn't inflate it
+int applyInstanceCount(void** slot, void* info __attribute__ ((unused)))
+{
+  const struct InstanceCount* ic = (const struct InstanceCount*)*slot;
+  struct RecordInfo* ri = (struct RecordInfo*)htab_find_with_hash(recordTable, ic->name, htab_hash_string(ic->name));
+  if (ri)
+    ri->staticCount = ic->count;
+  return 1;
+}
+
+void usage(const char* progName)
+{
+  printf("Usage: %s dumpfile [threads=N] [binary...]\n", progName);
+}
+
+// Readers never read at or past end. On overrun they set position to null and
+// return zero, further reads from null position fail too, so caller can check
+// position once after series of reads.
+static uint64_t readU(const uint8_t** p, const uint8_t* end, int size)
+{
+  if (!*p || end - *p < size)
+  {
+    *p = 0;
+    return 0;
+  }
+
+  uint64_t value = 0;
+  for (int i = 0; i < size; i++)
+    value |= (uint64_t)(*p)[i] << (8 * i);
+  *p += size;
+  return value;
+}
+
+static uint64_t readULEB(const uint8_t** p, const uint8_t* end)
+{
+  uint64_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+  do
+  {
+    if (!*p || *p >= end)
+    {
+      *p = 0;
+      return 0;
+    }
+    byte = *(*p)++;
+    if (shift < 64)
+      value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  }
+  while (byte & 0x80);
+  return value;
+}
+
+static int64_t readSLEB(const uint8_t** p, const uint8_t* end)
+{
+  int64_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+  do
+  {
+    if (!*p || *p >= end)
+    {
+      *p = 0;
+      return 0;
+    }
+    byte = *(*p)++;
+    if (shift < 64)
+      value |= (int64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  }
+  while (byte & 0x80);
+  if (shift < 64 && (byte & 0x40))
+    value |= -((int64_t)1 << shift);
+  return value;
+}
+
+// Read NUL terminated string, 0 if it isn't terminated before end
+static const char* readString(const uint8_t** p, const uint8_t* end)
+{
+  const uint8_t* nul = *p ? (const uint8_t*)memchr(*p, 0, end - *p) : 0;
+  if (!nul)
+  {
+    *p = 0;
+    return 0;
+  }
+
+  const char* string = (const char*)*p;
+  *p = nul + 1;
+  return string;
+}
+
+// Skip block of given size
+static const uint8_t* readBlock(const uint8_t** p, const uint8_t* end, uint64_t size)
+{
+  if (!*p || (uint64_t)(end - *p) < size)
+  {
+    *p = 0;
+    return 0;
+  }
+
+  const uint8_t* block = *p;
+  *p += size;
+  return block;
+}
+
+static const char* sectionString(const struct DebugSection* section, uint64_t offset)
+{
+  if (offset >= section->size || !memchr(section->data + offset, 0, section->size - offset))
+    return 0;
+  return (const char*)section->data + offset;
+}
+
+// Read attribute value of given form. Returns false on unknown form or if
+// value doesn't fit before end.
+static bool readForm(const struct Unit* unit, const uint8_t** p, const uint8_t* end, uint64_t form,
+  int64_t implicitConst, struct AttrValue* av)
+{
+  memset(av, 0, sizeof(*av));
+  switch (form)
+  {
+  case DW_FORM_addr:
+    av->value = readU(p, end, unit->addressSize);
+    break;
+  case DW_FORM_data1:
+  case DW_FORM_ref1:
+  case DW_FORM_flag:
+  case DW_FORM_strx1:
+  case DW_FORM_addrx1:
+    av->value = readU(p, end, 1);
+    break;
+  case DW_FORM_data2:
+  case DW_FORM_ref2:
+  case DW_FORM_strx2:
+  case DW_FORM_addrx2:
+    av->value = readU(p, end, 2);
+    break;
+  case DW_FORM_strx3:
+  case DW_FORM_addrx3:
+    av->value = readU(p, end, 3);
+    break;
+  case DW_FORM_data4:
+  case DW_FORM_ref4:
+  case DW_FORM_ref_sup4:
+  case DW_FORM_strx4:
+  case DW_FORM_addrx4:
+    av->value = readU(p, end, 4);
+    break;
+  case DW_FORM_data8:
+  case DW_FORM_ref8:
+  case DW_FORM_ref_sig8:
+  case DW_FORM_ref_sup8:
+    av->value = readU(p, end, 8);
+    break;
+  case DW_FORM_data16:
+    av->blockSize = 16;
+    av->block = readBlock(p, end, av->blockSize);
+    break;
+  case DW_FORM_sdata:
+    av->value = readSLEB(p, end);
+    break;
+  case DW_FORM_udata:
+  case DW_FORM_ref_udata:
+  case DW_FORM_strx:
+  case DW_FORM_addrx:
+  case DW_FORM_loclistx:
+  case DW_FORM_rnglistx:
+    av->value = readULEB(p, end);
+    break;
+  case DW_FORM_string:
+    av->string = readString(p, end);
+    break;
+  case DW_FORM_strp:
+    av->value = readU(p, end, unit->offsetSize);
+    av->string = sectionString(&unit->file->str, av->value);
+    break;
+  case DW_FORM_line_strp:
+    av->value = readU(p, end, unit->offsetSize);
+    av->string = sectionString(&unit->file->lineStr, av->value);
+    break;
+  case DW_FORM_ref_addr:
+    av->value = readU(p, end, unit->version <= 2 ? unit->addressSize : unit->offsetSize);
+    break;
+  case DW_FORM_sec_offset:
+  case DW_FORM_strp_sup:
+    av->value = readU(p, end, unit->offsetSize);
+    break;
+  case DW_FORM_flag_present:
+    av->value = 1;
+    break;
+  case DW_FORM_implicit_const:
+    av->value = implicitConst;
+    break;
+  case DW_FORM_exprloc:
+  case DW_FORM_block:
+    av->blockSize = readULEB(p, end);
+    av->block = readBlock(p, end, av->blockSize);
+    break;
+  case DW_FORM_block1:
+    av->blockSize = readU(p, end, 1);
+    av->block = readBlock(p, end, av->blockSize);
+    break;
+  case DW_FORM_block2:
+    av->blockSize = readU(p, end, 2);
+    av->block = readBlock(p, end, av->blockSize);
+    break;
+  case DW_FORM_block4:
+    av->blockSize = readU(p, end, 4);
+    av->block = readBlock(p, end, av->blockSize);
+    break;
+  case DW_FORM_indirect:
+    return readForm(unit, p, end, readULEB(p, end), implicitConst, av);
+  default:
+    return false;
+  }
+  if (!*p)
+    return false;
+
+  // Resolve string offsets table index
+  if (form == DW_FORM_strx || form == DW_FORM_strx1 || form == DW_FORM_strx2 || form == DW_FORM_strx3 ||
+    form == DW_FORM_strx4)
+  {
+    const struct DebugSection* strOffsets = &unit->file->strOffsets;
+    const uint64_t entry = unit->strOffsetsBase + av->value * unit->offsetSize;
+    if (entry + unit->offsetSize <= strOffsets->size)
+    {
+      const uint8_t* e = strOffsets->data + entry;
+      av->string = sectionString(&unit->file->str, readU(&e, strOffsets->data + strOffsets->size, unit->offsetSize));
+    }
+  }
+
+  return true;
+}
+
+static bool isReferenceForm(uint64_t form)
+{
+  return form == DW_FORM_ref1 || form == DW_FORM_ref2 || form == DW_FORM_ref4 || form == DW_FORM_ref8 ||
+    form == DW_FORM_ref_udata;
+}
+
+static bool loadAbbrevs(struct Unit* unit, size_t offset)
+{
+  const struct DebugSection* section = &unit->file->abbrev;
+  if (offset >= section->size)
+    return false;
+
+  const uint8_t* p = section->data + offset;
+  const uint8_t* end = section->data + section->size;
+  size_t capacity = 64;
+  unit->abbrevs = (struct Abbrev*)xcalloc(capacity, sizeof(struct Abbrev));
+  while (p < end)
+  {
+    uint64_t code = readULEB(&p, end);
+    if (!p)
+      return false;
+    if (code == 0)
+      break;
+    // Codes are assigned sequentially, huge one means broken data
+    if (code > section->size)
+      return false;
+
+    if (code >= capacity)
+    {
+      size_t newCapacity = capacity;
+      while (code >= newCapacity)
+        newCapacity *= 2;
+      unit->abbrevs = (struct Abbrev*)xrealloc(unit->abbrevs, newCapacity * sizeof(struct Abbrev));
+      memset(unit->abbrevs + capacity, 0, (newCapacity - capacity) * sizeof(struct Abbrev));
+      capacity = newCapacity;
+    }
+    if (code >= unit->abbrevCount)
+      unit->abbrevCount = code + 1;
+
+    struct Abbrev* abbrev = &unit->abbrevs[code];
+    // Same code defined twice means broken data
+    if (abbrev->attrs)
+      return false;
+    abbrev->tag = readULEB(&p, end);
+    abbrev->hasChildren = readU(&p, end, 1);
+    size_t attrCapacity = 8;
+    abbrev->attrs = (struct AbbrevAttr*)xmalloc(attrCapacity * sizeof(struct AbbrevAttr));
+    for (;;)
+    {
+      struct AbbrevAttr attr;
+      attr.name = readULEB(&p, end);
+      attr.form = readULEB(&p, end);
+      attr.implicitConst = attr.form == DW_FORM_implicit_const ? readSLEB(&p, end) : 0;
+      if (!p)
+        return false;
+      if (attr.name == 0 && attr.form == 0)
+        break;
+
+      if (abbrev->attrCount == attrCapacity)
+      {
+        attrCapacity *= 2;
+        abbrev->attrs = (struct AbbrevAttr*)xrealloc(abbrev->attrs, attrCapacity * sizeof(struct AbbrevAttr));
+      }
+      abbrev->attrs[abbrev->attrCount++] = attr;
+    }
+  }
+
+  return true;
+}
+
+// Evaluate simple location expression used for member offsets
+static uint64_t evalMemberLocation(const struct AttrValue* av, bool* ok)
+{
+  if (!av->block)
+    return av->value;
+
+  const uint8_t* p = av->block;
+  const uint8_t* end = av->block + av->blockSize;
+  uint64_t value = 0;
+  while (p && p < end)
+  {
+    const uint8_t op = *p++;
+    if (op == DW_OP_plus_uconst)
+      value += readULEB(&p, end);
+    else if (op == DW_OP_constu)
+      value = readULEB(&p, end);
+    else
+    {
+      // Virtual base offsets are calculated at runtime
+      *ok = false;
+      return 0;
+    }
+  }
+  *ok = p != 0;
+  return value;
+}
+
+static void setDieAttr(struct Unit* unit, struct Die* die, const struct AbbrevAttr* attr,
+  const struct AttrValue* av)
+{
+  uint64_t ref = av->value;
+  if (isReferenceForm(attr->form))
+    ref += unit->offset;
+  else if (attr->form != DW_FORM_ref_addr)
+    ref = 0;
+
+  switch (attr->name)
+  {
+  case DW_AT_name:
+    die->name = av->string;
+    break;
+  case DW_AT_byte_size:
+    die->byteSize = av->value;
+    die->hasByteSize = true;
+    break;
+  case DW_AT_bit_size:
+    die->bitSize = av->value;
+    die->hasBitSize = true;
+    break;
+  case DW_AT_bit_offset:
+    die->bitOffset = av->value;
+    die->hasBitOffset = true;
+    break;
+  case DW_AT_data_bit_offset:
+    die->dataBitOffset = av->value;
+    die->hasDataBitOffset = true;
+    break;
+  case DW_AT_data_member_location:
+  {
+    bool ok = true;
+    die->memberLocation = evalMemberLocation(av, &ok);
+    die->hasMemberLocation = ok;
+    break;
+  }
+  case DW_AT_type:
+    die->type = ref;
+    break;
+  case DW_AT_specification:
+    die->specification = ref;
+    break;
+  case DW_AT_alignment:
+    die->alignment = av->value;
+    break;
+  case DW_AT_count:
+    die->count = av->value;
+    die->hasCount = true;
+    break;
+  case DW_AT_upper_bound:
+    die->count = av->value + 1;
+    die->hasCount = true;
+    break;
+  case DW_AT_encoding:
+    die->encoding = av->value;
+    break;
+  case DW_AT_decl_file:
+    die->declFile = av->value;
+    break;
+  case DW_AT_decl_line:
+    die->declLine = av->value;
+    break;
+  case DW_AT_const_value:
+    die->constValue = av->value;
+    if (attr->form == DW_FORM_data1)
+      die->constSize = 1;
+    else if (attr->form == DW_FORM_data2)
+      die->constSize = 2;
+    else if (attr->form == DW_FORM_data4)
+      die->constSize = 4;
+    break;
+  case DW_AT_declaration:
+    die->isDeclaration = av->value != 0;
+    break;
+  case DW_AT_artificial:
+    die->isArtificial = av->value != 0;
+    break;
+  case DW_AT_virtuality:
+    die->isVirtual = av->value != 0;
+    break;
+  case DW_AT_location:
+    die->hasLocation = true;
+    if (av->block && av->blockSize == 1 + (uint64_t)unit->addressSize && av->block[0] == DW_OP_addr)
+    {
+      const uint8_t* address = av->block + 1;
+      die->address = readU(&address, av->block + av->blockSize, unit->addressSize);
+      die->hasAddress = true;
+    }
+    break;
+  case DW_AT_linkage_name:
+  case DW_AT_MIPS_linkage_name:
+    die->linkageName = av->string;
+    break;
+  case DW_AT_external:
+    die->isExternal = av->value != 0;
+    break;
+  case DW_AT_str_offsets_base:
+    unit->strOffsetsBase = av->value;
+    break;
+  case DW_AT_stmt_list:
+    if (die->tag == DW_TAG_compile_unit || die->tag == DW_TAG_partial_unit)
+    {
+      unit->stmtList = av->value;
+      unit->hasStmtList = true;
+    }
+    break;
+  default:;
+  }
+}
+
+static size_t findDie(const struct Unit* unit, uint64_t offset)
+{
+  size_t lo = 0;
+  size_t hi = unit->dieCount;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (unit->dies[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < unit->dieCount && unit->dies[lo].offset == offset)
+    return lo;
+  return NO_DIE;
+}
+
+static bool loadDies(struct Unit* unit, const uint8_t* p)
+{
+  const uint8_t* end = unit->file->info.data + unit->end;
+  size_t parentStack[256];
+  size_t lastChildStack[256];
+  int depth = 0;
+  parentStack[0] = NO_DIE;
+  lastChildStack[0] = NO_DIE;
+
+  unit->dieCapacity = 1024;
+  unit->dies = (struct Die*)xmalloc(unit->dieCapacity * sizeof(struct Die));
+  while (p < end)
+  {
+    const size_t offset = p - unit->file->info.data;
+    uint64_t code = readULEB(&p, end);
+    if (!p)
+      return false;
+    if (code == 0)
+    {
+      // End of children list
+      if (depth == 0)
+        continue;
+      depth--;
+      continue;
+    }
+    if (code >= unit->abbrevCount || !unit->abbrevs[code].attrs)
+      return false;
+
+    const struct Abbrev* abbrev = &unit->abbrevs[code];
+    if (unit->dieCount == unit->dieCapacity)
+    {
+      unit->dieCapacity *= 2;
+      unit->dies = (struct Die*)xrealloc(unit->dies, unit->dieCapacity * sizeof(struct Die));
+    }
+    const size_t idx = unit->dieCount++;
+    struct Die* die = &unit->dies[idx];
+    memset(die, 0, sizeof(*die));
+    die->offset = offset;
+    die->tag = abbrev->tag;
+    die->parent = parentStack[depth];
+    die->firstChild = NO_DIE;
+    die->nextSibling = NO_DIE;
+
+    if (die->parent == NO_DIE)
+      die->atNamespaceScope = true;
+    else
+    {
+      const struct Die* parent = &unit->dies[die->parent];
+      die->atNamespaceScope = parent->tag == DW_TAG_compile_unit || parent->tag == DW_TAG_partial_unit ||
+        (parent->tag == DW_TAG_namespace && parent->atNamespaceScope);
+    }
+
+    // Link DIE into its parent children list
+    if (lastChildStack[depth] != NO_DIE)
+      unit->dies[lastChildStack[depth]].nextSibling = idx;
+    else if (die->parent != NO_DIE)
+      unit->dies[die->parent].firstChild = idx;
+    lastChildStack[depth] = idx;
+
+    for (size_t i = 0; i < abbrev->attrCount; i++)
+    {
+      struct AttrValue av;
+      if (!readForm(unit, &p, end, abbrev->attrs[i].form, abbrev->attrs[i].implicitConst, &av))
+        return false;
+      setDieAttr(unit, die, &abbrev->attrs[i], &av);
+    }
+
+    if (abbrev->hasChildren)
+    {
+      if (depth + 1 >= (int)(sizeof(parentStack) / sizeof(parentStack[0])))
+        return false;
+      depth++;
+      parentStack[depth] = idx;
+      lastChildStack[depth] = NO_DIE;
+    }
+  }
+
+  return true;
+}
+
+// Read file names from line table header. Returns false on invalid data.
+static bool loadFileNames(struct Unit* unit, uint64_t stmtList)
+{
+  const struct DebugSection* section = &unit->file->line;
+  if (stmtList >= section->size)
+    return false;
+
+  const uint8_t* p = section->data + stmtList;
+  const uint8_t* end = section->data + section->size;
+  struct Unit lineUnit = *unit;
+  uint64_t length = readU(&p, end, 4);
+  lineUnit.offsetSize = 4;
+  if (length == 0xffffffff)
+  {
+    length = readU(&p, end, 8);
+    lineUnit.offsetSize = 8;
+  }
+  if (!p || length > (uint64_t)(end - p))
+    return false;
+  end = p + length;
+
+  lineUnit.version = readU(&p, end, 2);
+  if (lineUnit.version >= 5)
+  {
+    lineUnit.addressSize = readU(&p, end, 1);
+    readU(&p, end, 1);
+  }
+  readU(&p, end, lineUnit.offsetSize);
+  readBlock(&p, end, lineUnit.version >= 4 ? 5 : 4);
+  const uint8_t opcodeBase = readU(&p, end, 1);
+  readBlock(&p, end, opcodeBase ? opcodeBase - 1 : 0);
+  if (!p)
+    return false;
+
+  size_t dirCount = 0;
+  size_t dirCapacity = 16;
+  const char** dirs = (const char**)xmalloc(dirCapacity * sizeof(const char*));
+  size_t fileCapacity = 16;
+  unit->fileNames = (char**)xmalloc(fileCapacity * sizeof(char*));
+
+  if (lineUnit.version >= 5)
+  {
+    for (int pass = 0; pass < 2; pass++)
+    {
+      const uint8_t formatCount = readU(&p, end, 1);
+      uint64_t formats[2 * 256];
+      for (int i = 0; i < formatCount; i++)
+      {
+        formats[2 * i] = readULEB(&p, end);
+        formats[2 * i + 1] = readULEB(&p, end);
+      }
+      const uint64_t count = readULEB(&p, end);
+      // Each entry takes at least one byte, so broken count can't make us loop
+      // for long
+      if (!p || (count && !formatCount) || count > (uint64_t)(end - p))
+        goto out;
+      for (uint64_t j = 0; j < count; j++)
+      {
+        const char* path = "";
+        uint64_t dirIndex = 0;
+        for (int i = 0; i < formatCount; i++)
+        {
+          struct AttrValue av;
+          if (!readForm(&lineUnit, &p, end, formats[2 * i + 1], 0, &av))
+            goto out;
+          if (formats[2 * i] == DW_LNCT_path && av.string)
+            path = av.string;
+          else if (formats[2 * i] == DW_LNCT_directory_index)
+            dirIndex = av.value;
+        }
+
+        if (pass == 0)
+        {
+          if (dirCount == dirCapacity)
+          {
+            dirCapacity *= 2;
+            dirs = (const char**)xrealloc(dirs, dirCapacity * sizeof(const char*));
+          }
+          dirs[dirCount++] = path;
+          continue;
+        }
+
+        if (unit->fileNameCount == fileCapacity)
+        {
+          fileCapacity *= 2;
+          unit->fileNames = (char**)xrealloc(unit->fileNames, fileCapacity * sizeof(char*));
+        }
+        // Directory 0 is compilation directory, keep such names relative
+        if (*path == '/' || dirIndex == 0 || dirIndex >= dirCount)
+          unit->fileNames[unit->fileNameCount++] = xstrdup(path);
+        else
+          unit->fileNames[unit->fileNameCount++] = concat(dirs[dirIndex], "/", path, NULL);
+      }
+    }
+  }
+  else
+  {
+    // Directory 0 and file 0 are implicit before DWARF 5. Directory and file
+    // lists end with empty string.
+    dirs[dirCount++] = "";
+    unit->fileNames[unit->fileNameCount++] = xstrdup("");
+    for (;;)
+    {
+      const char* dir = readString(&p, end);
+      if (!dir)
+        goto out;
+      if (!*dir)
+        break;
+
+      if (dirCount == dirCapacity)
+      {
+        dirCapacity *= 2;
+        dirs = (const char**)xrealloc(dirs, dirCapacity * sizeof(const char*));
+      }
+      dirs[dirCount++] = dir;
+    }
+    for (;;)
+    {
+      const char* path = readString(&p, end);
+      if (!path)
+        goto out;
+      if (!*path)
+        break;
+      const uint64_t dirIndex = readULEB(&p, end);
+      readULEB(&p, end);
+      readULEB(&p, end);
+      if (!p)
+        goto out;
+
+      if (unit->fileNameCount == fileCapacity)
+      {
+        fileCapacity *= 2;
+        unit->fileNames = (char**)xrealloc(unit->fileNames, fileCapacity * sizeof(char*));
+      }
+      if (*path == '/' || dirIndex == 0 || dirIndex >= dirCount)
+        unit->fileNames[unit->fileNameCount++] = xstrdup(path);
+      else
+        unit->fileNames[unit->fileNameCount++] = concat(dirs[dirIndex], "/", path, NULL);
+    }
+  }
+
+  free(dirs);
+  return true;
+
+out:
+  free(dirs);
+  return false;
+}
+
+static size_t resolveType(const struct Unit* unit, uint64_t offset)
+{
+  return offset ? findDie(unit, offset) : NO_DIE;
+}
+
+// Skip typedefs and cv-qualifiers
+static size_t stripType(const struct Unit* unit, size_t idx)
+{
+  while (idx != NO_DIE)
+  {
+    const struct Die* die = &unit->dies[idx];
+    if (die->tag != DW_TAG_typedef && die->tag != DW_TAG_const_type && die->tag != DW_TAG_volatile_type &&
+      die->tag != DW_TAG_restrict_type && die->tag != DW_TAG_atomic_type)
+      break;
+    idx = resolveType(unit, die->type);
+  }
+  return idx;
+}
+
+// Type size in bits
+static uint64_t typeSize(const struct Unit* unit, size_t idx)
+{
+  idx = stripType(unit, idx);
+  if (idx == NO_DIE)
+    return 0;
+
+  const struct Die* die = &unit->dies[idx];
+  if (die->tag == DW_TAG_array_type)
+  {
+    uint64_t size = typeSize(unit, resolveType(unit, die->type));
+    for (size_t child = die->firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+      if (unit->dies[child].tag == DW_TAG_subrange_type)
+        size *= unit->dies[child].hasCount ? unit->dies[child].count : 0;
+    return size;
+  }
+  if (die->hasByteSize)
+    return die->byteSize * 8;
+  // Itanium C++ ABI pointer to member function is function pointer and this
+  // adjustment, pointer to data member is offset
+  if (die->tag == DW_TAG_ptr_to_member_type)
+  {
+    const size_t pointee = stripType(unit, resolveType(unit, die->type));
+    if (pointee != NO_DIE && unit->dies[pointee].tag == DW_TAG_subroutine_type)
+      return unit->addressSize * 16;
+    return unit->addressSize * 8;
+  }
+  if (die->tag == DW_TAG_pointer_type || die->tag == DW_TAG_reference_type ||
+    die->tag == DW_TAG_rvalue_reference_type)
+    return unit->addressSize * 8;
+  return 0;
+}
+
+static bool isRecordTag(uint64_t tag)
+{
+  return tag == DW_TAG_structure_type || tag == DW_TAG_class_type || tag == DW_TAG_union_type;
+}
+
+// Type alignment in bits. Natural alignment ignores alignas() and aligned
+// attributes of type and its members.
+static uint64_t computeAlign(struct Unit* unit, size_t idx, bool natural)
+{
+  uint64_t* aligns = natural ? unit->naturalAligns : unit->aligns;
+  while (idx != NO_DIE)
+  {
+    const struct Die* die = &unit->dies[idx];
+    // alignas() is reported via DW_AT_alignment
+    if (die->alignment && !natural)
+      return die->alignment * 8;
+    if (die->tag != DW_TAG_typedef && die->tag != DW_TAG_const_type && die->tag != DW_TAG_volatile_type &&
+      die->tag != DW_TAG_restrict_type && die->tag != DW_TAG_atomic_type && die->tag != DW_TAG_array_type)
+      break;
+    idx = resolveType(unit, die->type);
+  }
+  if (idx == NO_DIE)
+    return 8;
+
+  if (aligns[idx])
+    return aligns[idx];
+
+  const struct Die* die = &unit->dies[idx];
+  uint64_t align = 8;
+  if (isRecordTag(die->tag))
+  {
+    // Guard against recursion through broken references
+    aligns[idx] = 8;
+    for (size_t child = die->firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+    {
+      const struct Die* member = &unit->dies[child];
+      if ((member->tag != DW_TAG_member && member->tag != DW_TAG_inheritance) || member->isDeclaration)
+        continue;
+      uint64_t memberAlign = member->alignment && !natural ? member->alignment * 8 :
+        computeAlign(unit, resolveType(unit, member->type), natural);
+      if (memberAlign > align)
+        align = memberAlign;
+    }
+  }
+  else if (die->tag == DW_TAG_base_type && die->encoding == DW_ATE_complex_float)
+    align = typeSize(unit, idx) / 2;
+  else if (die->tag == DW_TAG_ptr_to_member_type)
+    align = unit->addressSize * 8;
+  else
+  {
+    align = typeSize(unit, idx);
+    if (die->tag == DW_TAG_enumeration_type && !die->hasByteSize)
+      align = computeAlign(unit, resolveType(unit, die->type), natural);
+  }
+  if (align < 8)
+    align = 8;
+
+  aligns[idx] = align;
+  return align;
+}
+
+static uint64_t typeAlign(struct Unit* unit, size_t idx)
+{
+  return computeAlign(unit, idx, false);
+}
+
+static uint64_t naturalTypeAlign(struct Unit* unit, size_t idx)
+{
+  return computeAlign(unit, idx, true);
+}
+
+// Calculate size of smallest integer type holding all enumerators, in bits.
+// Returns 0 if there are no enumerators.
+static uint64_t enumTypeMinSize(const struct Unit* unit, size_t idx)
+{
+  // Fixed-size constants are sign extended according to underlying type
+  size_t underlying = stripType(unit, resolveType(unit, unit->dies[idx].type));
+  const bool isSigned = underlying != NO_DIE && (unit->dies[underlying].encoding == DW_ATE_signed ||
+    unit->dies[underlying].encoding == DW_ATE_signed_char);
+
+  int64_t minValue = 0;
+  uint64_t maxValue = 0;
+  bool hasEnumerators = false;
+  for (size_t child = unit->dies[idx].firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+  {
+    const struct Die* enumerator = &unit->dies[child];
+    if (enumerator->tag != DW_TAG_enumerator)
+      continue;
+    hasEnumerators = true;
+
+    uint64_t value = enumerator->constValue;
+    const int bits = enumerator->constSize * 8;
+    if (isSigned && bits && (value >> (bits - 1)) & 1)
+      value |= ~(uint64_t)0 << bits;
+
+    if (isSigned && (int64_t)value < 0)
+    {
+      if ((int64_t)value < minValue)
+        minValue = value;
+    }
+    else if (value > maxValue)
+      maxValue = value;
+  }
+
+  // Enum without enumerators is strong typedef of its underlying type
+  if (!hasEnumerators)
+    return 0;
+  return enumMinSize(minValue, maxValue);
+}
+
+static bool isEmptyRecord(const struct Unit* unit, size_t idx)
+{
+  const struct Die* die = &unit->dies[idx];
+  for (size_t child = die->firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+  {
+    const struct Die* member = &unit->dies[child];
+    if (member->tag == DW_TAG_member && !member->isDeclaration)
+      return false;
+    if (member->tag == DW_TAG_inheritance)
+    {
+      size_t base = stripType(unit, resolveType(unit, member->type));
+      if (member->isVirtual || base == NO_DIE || !isEmptyRecord(unit, base))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Find out parts std::optional, std::pair or std::variant field would be
+// split into from wrapper template type parameters
+static void flattenWrapper(struct Unit* unit, struct FieldInfo* fi, size_t idx)
+{
+  // Variant alternatives are children of parameter pack
+  size_t params[256];
+  size_t count = 0;
+  for (size_t child = unit->dies[idx].firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+  {
+    if (unit->dies[child].tag == DW_TAG_template_type_param && count < 256)
+      params[count++] = child;
+    else if (unit->dies[child].tag == DW_TAG_GNU_template_parameter_pack)
+      for (size_t param = unit->dies[child].firstChild; param != NO_DIE; param = unit->dies[param].nextSibling)
+        if (unit->dies[param].tag == DW_TAG_template_type_param && count < 256)
+          params[count++] = param;
+  }
+
+  size_t sizes[256];
+  size_t aligns[256];
+  for (size_t i = 0; i < count; i++)
+  {
+    const size_t type = resolveType(unit, unit->dies[params[i]].type);
+    if (type == NO_DIE)
+      return;
+    sizes[i] = typeSize(unit, type);
+    aligns[i] = typeAlign(unit, type);
+  }
+
+  flattenWrapperField(fi, fi->typeName, sizes, aligns, count);
+}
+
+// Virtual bases of bases aren't listed in record itself
+static bool hasVirtualBase(const struct Unit* unit, size_t idx)
+{
+  const struct Die* die = &unit->dies[idx];
+  for (size_t child = die->firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+  {
+    const struct Die* member = &unit->dies[child];
+    if (member->tag != DW_TAG_inheritance)
+      continue;
+    if (member->isVirtual || !member->hasMemberLocation)
+      return true;
+    size_t base = stripType(unit, resolveType(unit, member->type));
+    if (base != NO_DIE && hasVirtualBase(unit, base))
+      return true;
+  }
+  return false;
+}
+
+// Builds qualified record name. Returns 0 for anonymous records.
+static char* qualifiedName(const struct Unit* unit, size_t idx)
+{
+  const struct Die* die = &unit->dies[idx];
+  const char* name = die->name;
+  // Out-of-line definitions refer to declaration placed in proper scope
+  if (die->specification)
+  {
+    size_t spec = resolveType(unit, die->specification);
+    if (spec != NO_DIE)
+    {
+      idx = spec;
+      die = &unit->dies[idx];
+      if (!name)
+        name = die->name;
+    }
+  }
+  if (!name)
+    return 0;
+
+  char* result = xstrdup(name);
+  for (size_t parent = die->parent; parent != NO_DIE; parent = unit->dies[parent].parent)
+  {
+    const struct Die* scope = &unit->dies[parent];
+    if (scope->tag != DW_TAG_namespace && !isRecordTag(scope->tag))
+      break;
+    char* scoped = concat(scope->name ? scope->name : "{anonymous}", "::", result, NULL);
+    free(result);
+    result = scoped;
+  }
+  return result;
+}
+
+// Inline variables and static data members of templates are defined in each
+// unit using them. Linked binary has single definition at known address, in
+// object files addresses are relative to sections, so external variables are
+// identified by linkage name there. Returns 0 if variable is unique.
+static char* variableKey(const struct Unit* unit, size_t idx)
+{
+  const struct Die* die = &unit->dies[idx];
+  if (!unit->file->isRelocatable && die->hasAddress)
+  {
+    char address[32];
+    snprintf(address, sizeof(address), ":%llx", (unsigned long long)die->address);
+    return concat(unit->file->path, address, NULL);
+  }
+
+  const size_t spec = die->specification ? resolveType(unit, die->specification) : NO_DIE;
+  const struct Die* decl = spec != NO_DIE ? &unit->dies[spec] : 0;
+  if (!die->isExternal && !(decl && decl->isExternal))
+    return 0;
+  if (die->linkageName)
+    return xstrdup(die->linkageName);
+  if (decl && decl->linkageName)
+    return xstrdup(decl->linkageName);
+  return qualifiedName(unit, idx);
+}
+
+static struct FieldInfo* createFieldInfo(const char* name, bool isSpecial)
+{
+  struct FieldInfo* fi = (struct FieldInfo*)xcalloc(1, sizeof(struct FieldInfo));
+  fi->name = xstrdup(name);
+  fi->isSpecial = isSpecial;
+  return fi;
+}
+
+static struct RecordInfo* createRecordInfo(struct Unit* unit, size_t idx, char* name)
+{
+  const struct Die* die = &unit->dies[idx];
+  struct RecordInfo* ri = (struct RecordInfo*)xcalloc(1, sizeof(struct RecordInfo));
+  ri->name = name;
+  ri->fileName = xstrdup(die->declFile < unit->fileNameCount ? unit->fileNames[die->declFile] : "");
+  ri->line = die->declLine;
+  ri->size = die->byteSize * 8;
+  ri->align = typeAlign(unit, idx);
+  ri->isUnion = die->tag == DW_TAG_union_type;
+  ri->naturalAlign = naturalTypeAlign(unit, idx);
+  ri->firstField = SIZE_MAX;
+  ri->estMinSize = SIZE_MAX;
+  ri->hasVirtualBase = hasVirtualBase(unit, idx);
+
+  size_t fieldCapacity = 4;
+  ri->fields = (struct FieldInfo**)xmalloc(fieldCapacity * sizeof(struct FieldInfo*));
+  // Field which type doesn't tell its size, it takes space up to next field
+  struct FieldInfo* unsized = 0;
+  for (size_t child = die->firstChild; child != NO_DIE; child = unit->dies[child].nextSibling)
+  {
+    const struct Die* member = &unit->dies[child];
+    if (member->tag == DW_TAG_template_type_param || member->tag == DW_TAG_template_value_param ||
+      member->tag == DW_TAG_GNU_template_parameter_pack)
+    {
+      ri->isInstance = true;
+      continue;
+    }
+
+    size_t type = resolveType(unit, member->type);
+    struct FieldInfo* fi;
+    if (member->tag == DW_TAG_inheritance)
+    {
+      // Virtual bases are placed at offsets known at runtime only
+      if (member->isVirtual || !member->hasMemberLocation)
+        continue;
+      // GNU C++ doesn't create fields for empty bases
+      size_t base = stripType(unit, type);
+      if (base == NO_DIE || isEmptyRecord(unit, base))
+        continue;
+      fi = createFieldInfo("base/vptr", true);
+    }
+    else if (member->tag == DW_TAG_member)
+    {
+      // Static data members (DWARF 4 and earlier). Union members may have no
+      // location as they all are placed at offset 0.
+      if (member->isDeclaration || (!member->hasMemberLocation && !member->hasDataBitOffset && !ri->isUnion))
+        continue;
+      if (member->isArtificial)
+        fi = createFieldInfo("base/vptr", true);
+      else
+        fi = createFieldInfo(member->name ? member->name : "unnamed", false);
+    }
+    else
+      continue;
+
+    fi->size = typeSize(unit, type);
+    if (!fi->size && member->hasByteSize && !member->hasBitSize)
+      fi->size = member->byteSize * 8;
+    fi->offset = member->memberLocation * 8;
+    if (unsized && fi->offset > unsized->offset)
+      unsized->size = fi->offset - unsized->offset;
+    unsized = 0;
+    // Zero-sized arrays (flexible array members) are legal
+    const size_t plainMemberType = stripType(unit, type);
+    if (!fi->size && !member->hasBitSize && plainMemberType != NO_DIE &&
+      unit->dies[plainMemberType].tag != DW_TAG_array_type)
+      unsized = fi;
+    fi->align = member->alignment ? member->alignment * 8 : typeAlign(unit, type);
+    fi->naturalAlign = naturalTypeAlign(unit, type);
+    if (fi->naturalAlign > fi->align)
+      fi->naturalAlign = fi->align;
+    if (member->hasBitSize)
+    {
+      fi->isBitField = true;
+      fi->size = member->bitSize;
+      if (member->hasDataBitOffset)
+        fi->offset = member->dataBitOffset;
+      else if (member->hasBitOffset)
+      {
+        // DWARF 2/3 bit offset is counted from most significant bit of storage unit
+        uint64_t storageSize = member->hasByteSize ? member->byteSize * 8 : typeSize(unit, type);
+        fi->offset += storageSize - member->bitOffset - member->bitSize;
+      }
+    }
+
+    // Remember which record is embedded by value
+    size_t embedded = stripType(unit, type);
+    while (embedded != NO_DIE && unit->dies[embedded].tag == DW_TAG_array_type)
+      embedded = stripType(unit, resolveType(unit, unit->dies[embedded].type));
+    char* typeName = 0;
+    if (embedded != NO_DIE && isRecordTag(unit->dies[embedded].tag))
+      typeName = qualifiedName(unit, embedded);
+    fi->typeName = typeName ? typeName : xstrdup("");
+
+    const size_t plainType = stripType(unit, type);
+    fi->isBool = plainType != NO_DIE && unit->dies[plainType].tag == DW_TAG_base_type &&
+      unit->dies[plainType].encoding == DW_ATE_boolean && !fi->isBitField;
+    fi->isEmpty = !fi->isSpecial && plainType != NO_DIE && (unit->dies[plainType].tag == DW_TAG_structure_type ||
+      unit->dies[plainType].tag == DW_TAG_class_type) && isEmptyRecord(unit, plainType);
+
+    // Find out if enum (or array of enums) would fit into smaller underlying type
+    if (embedded != NO_DIE && unit->dies[embedded].tag == DW_TAG_enumeration_type && !fi->isBitField)
+    {
+      const uint64_t enumSize = typeSize(unit, embedded);
+      const uint64_t minSize = enumTypeMinSize(unit, embedded);
+      if (minSize && minSize < enumSize)
+      {
+        fi->enumSize = fi->size / enumSize * minSize;
+        fi->enumAlign = member->alignment ? fi->align : minSize;
+      }
+    }
+
+    // Find out how much pointer or reference (or array of them) would take if
+    // it was replaced by 32-bit offset or index
+    if (embedded != NO_DIE && (unit->dies[embedded].tag == DW_TAG_pointer_type ||
+      unit->dies[embedded].tag == DW_TAG_reference_type || unit->dies[embedded].tag == DW_TAG_rvalue_reference_type) &&
+      !fi->isSpecial && !fi->isBitField)
+    {
+      const uint64_t pointerSize = typeSize(unit, embedded);
+      if (pointerSize > COMPRESSED_POINTER_SIZE)
+      {
+        fi->pointerSize = fi->size / pointerSize * COMPRESSED_POINTER_SIZE;
+        fi->pointerAlign = member->alignment ? fi->align : COMPRESSED_POINTER_SIZE;
+      }
+    }
+
+    // Wrapper embedded by value (not array) could have its flag hoisted into
+    // record padding
+    if (plainType != NO_DIE && embedded == plainType && !fi->isSpecial && !fi->isBitField &&
+      isWrapperType(fi->typeName))
+      flattenWrapper(unit, fi, plainType);
+
+    ri->fieldCount++;
+    if (ri->fieldCount > fieldCapacity)
+    {
+      fieldCapacity *= 2;
+      ri->fields = (struct FieldInfo**)xrealloc(ri->fields, fieldCapacity * sizeof(struct FieldInfo*));
+    }
+    ri->fields[ri->fieldCount - 1] = fi;
+
+    if (fi->isBitField)
+      ri->hasBitFields = true;
+
+    if (fi->isSpecial)
+    {
+      if (ri->firstField != SIZE_MAX)
+        ri->hasVirtualBase = true;
+    }
+    else if (ri->firstField == SIZE_MAX)
+      ri->firstField = ri->fieldCount - 1;
+  }
+
+  if (unsized && ri->size > unsized->offset)
+    unsized->size = ri->size - unsized->offset;
+
+  ri->templateName = ri->isInstance ? templateFamilyName(ri->name) : xstrdup("");
+
+  // Compiler may place fields into tail padding of non-POD base. Base field
+  // covers only base data then, so let's trim it like GNU C++ does.
+  for (size_t i = 0; i + 1 < ri->fieldCount; i++)
+  {
+    struct FieldInfo* fi = ri->fields[i];
+    const size_t nextOffset = ri->fields[i + 1]->offset;
+    if (fi->isSpecial && nextOffset > fi->offset && fi->offset + fi->size > nextOffset)
+      fi->size = nextOffset - fi->offset;
+  }
+
+  return ri;
+}
+
+static void processUnit(struct UnitRef* ref)
+{
+  struct Unit unit;
+  memset(&unit, 0, sizeof(unit));
+  unit.file = ref->file;
+  unit.offset = ref->offset;
+
+  const struct DebugSection* info = &ref->file->info;
+  const uint8_t* p = info->data + ref->offset;
+  const uint8_t* end = info->data + info->size;
+  uint64_t length = readU(&p, end, 4);
+  unit.offsetSize = 4;
+  if (length == 0xffffffff)
+  {
+    length = readU(&p, end, 8);
+    unit.offsetSize = 8;
+  }
+  // collectUnits() checked that unit fits into section
+  end = p + length;
+  unit.end = end - info->data;
+  unit.version = readU(&p, end, 2);
+  uint64_t abbrevOffset;
+  if (unit.version >= 5)
+  {
+    const uint8_t unitType = readU(&p, end, 1);
+    unit.addressSize = readU(&p, end, 1);
+    abbrevOffset = readU(&p, end, unit.offsetSize);
+    // Type units and split units don't describe records we process
+    if (p && unitType != DW_UT_compile && unitType != DW_UT_partial)
+      return;
+    unit.strOffsetsBase = 8;
+  }
+  else
+  {
+    abbrevOffset = readU(&p, end, unit.offsetSize);
+    unit.addressSize = readU(&p, end, 1);
+  }
+  if (!p || unit.version < 2 || unit.version > 5 || (unit.addressSize != 4 && unit.addressSize != 8))
+  {
+    fprintf(stderr, "%s: unsupported DWARF unit at offset %zu\n", ref->file->path, ref->offset);
+    return;
+  }
+
+  // Unit DIE holds line table reference which gives us source file names
+  if (!loadAbbrevs(&unit, abbrevOffset) || !loadDies(&unit, p) ||
+    (unit.hasStmtList && !loadFileNames(&unit, unit.stmtList)))
+    fprintf(stderr, "%s: invalid DWARF data in unit at offset %zu\n", ref->file->path, ref->offset);
+  else if (unit.dieCount)
+  {
+    unit.aligns = (uint64_t*)xcalloc(unit.dieCount, sizeof(uint64_t));
+    unit.naturalAligns = (uint64_t*)xcalloc(unit.dieCount, sizeof(uint64_t));
+    for (size_t i = 0; i < unit.dieCount; i++)
+    {
+      const struct Die* die = &unit.dies[i];
+      // Just like plugin does we're interested in complete structs/classes/unions
+      // declared at namespace scope
+      if (!isRecordTag(die->tag) || die->isDeclaration ||
+        !die->hasByteSize || !die->atNamespaceScope)
+        continue;
+
+      char* name = qualifiedName(&unit, i);
+      if (!name)
+        continue;
+
+      const hashval_t hash = htab_hash_string(name);
+      pthread_mutex_lock(&storageMutex);
+      bool isProcessed = htab_find_with_hash(recordTable, name, hash) != 0;
+      pthread_mutex_unlock(&storageMutex);
+      if (isProcessed)
+      {
+        free(name);
+        continue;
+      }
+
+      struct RecordInfo* ri = createRecordInfo(&unit, i, name);
+      estimateMinRecordSize(ri);
+
+      // Other thread could process same record meanwhile
+      pthread_mutex_lock(&storageMutex);
+      void** slot = htab_find_slot_with_hash(recordTable, ri->name, hash, INSERT);
+      if (!*slot)
+      {
+        *slot = ri;
+        appendRecordInfo(storage, ri);
+        ri = 0;
+      }
+      pthread_mutex_unlock(&storageMutex);
+      if (ri)
+        deleteRecordInfo(ri);
+    }
+
+    // Count record instances in static storage. Static data member
+    // definitions are placed at unit scope as well.
+    for (size_t i = 0; i < unit.dieCount; i++)
+    {
+      const struct Die* die = &unit.dies[i];
+      if (die->tag != DW_TAG_variable || die->isDeclaration || !die->hasLocation || !die->atNamespaceScope)
+        continue;
+
+      size_t instanceCount = 1;
+      size_t type = stripType(&unit, resolveType(&unit, die->type));
+      if (type == NO_DIE && die->specification)
+      {
+        size_t spec = resolveType(&unit, die->specification);
+        if (spec != NO_DIE)
+          type = stripType(&unit, resolveType(&unit, unit.dies[spec].type));
+      }
+      while (type != NO_DIE && unit.dies[type].tag == DW_TAG_array_type)
+      {
+        const struct Die* array = &unit.dies[type];
+        for (size_t child = array->firstChild; child != NO_DIE; child = unit.dies[child].nextSibling)
+          if (unit.dies[child].tag == DW_TAG_subrange_type)
+            instanceCount *= unit.dies[child].hasCount ? unit.dies[child].count : 0;
+        type = stripType(&unit, resolveType(&unit, array->type));
+      }
+      if (type == NO_DIE || !instanceCount || !isRecordTag(unit.dies[type].tag))
+        continue;
+
+      char* name = qualifiedName(&unit, type);
+      if (!name)
+        continue;
+
+      char* key = variableKey(&unit, i);
+      pthread_mutex_lock(&storageMutex);
+      void** slot = key ? htab_find_slot(variableTable, key, INSERT) : 0;
+      if (slot && *slot)
+        free(key);
+      else
+      {
+        if (slot)
+          *slot = key;
+        slot = htab_find_slot_with_hash(instanceTable, name, htab_hash_string(name), INSERT);
+        if (!*slot)
+        {
+          struct InstanceCount* ic = (struct InstanceCount*)xcalloc(1, sizeof(struct InstanceCount));
+          ic->name = name;
+          name = 0;
+          *slot = ic;
+        }
+        ((struct InstanceCount*)*slot)->count += instanceCount;
+      }
+      pthread_mutex_unlock(&storageMutex);
+      free(name);
+    }
+  }
+
+  for (size_t i = 0; i < unit.abbrevCount; i++)
+    free(unit.abbrevs[i].attrs);
+  free(unit.abbrevs);
+  for (size_t i = 0; i < unit.fileNameCount; i++)
+    free(unit.fileNames[i]);
+  free(unit.fileNames);
+  free(unit.aligns);
+  free(unit.naturalAligns);
+  free(unit.dies);
+}
+
+static void* worker(void* arg __attribute__ ((unused)))
+{
+  for (;;)
+  {
+    size_t idx = __sync_fetch_and_add(&nextUnit, 1);
+    if (idx >= unitCount)
+      break;
+    processUnit(&units[idx]);
+  }
+  return 0;
+}
+
+// Apply relocations to debug section copy. Needed for object files only.
+static void relocateSection(struct InputFile* file, const Elf64_Shdr* shdrs, size_t shnum, size_t sectionIdx,
+  uint8_t** copy, struct DebugSection* section)
+{
+  const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)file->map;
+  for (size_t i = 0; i < shnum; i++)
+  {
+    if (shdrs[i].sh_type != SHT_RELA || shdrs[i].sh_info != sectionIdx || shdrs[i].sh_link >= shnum)
+      continue;
+
+    if (!*copy)
+    {
+      *copy = (uint8_t*)xmalloc(section->size);
+      memcpy(*copy, section->data, section->size);
+      section->data = *copy;
+    }
+
+    const Elf64_Shdr* symtab = &shdrs[shdrs[i].sh_link];
+    const Elf64_Sym* syms = (const Elf64_Sym*)((const uint8_t*)file->map + symtab->sh_offset);
+    const size_t symCount = symtab->sh_size / sizeof(Elf64_Sym);
+    const Elf64_Rela* relas = (const Elf64_Rela*)((const uint8_t*)file->map + shdrs[i].sh_offset);
+    const size_t relaCount = shdrs[i].sh_size / sizeof(Elf64_Rela);
+    for (size_t j = 0; j < relaCount; j++)
+    {
+      const size_t sym = ELF64_R_SYM(relas[j].r_info);
+      const uint32_t type = ELF64_R_TYPE(relas[j].r_info);
+      if (sym >= symCount)
+        continue;
+      const uint64_t value = syms[sym].st_value + relas[j].r_addend;
+
+      int size = 0;
+      if ((ehdr->e_machine == EM_X86_64 && (type == R_X86_64_32 || type == R_X86_64_32S)) ||
+        (ehdr->e_machine == EM_AARCH64 && type == R_AARCH64_ABS32))
+        size = 4;
+      else if ((ehdr->e_machine == EM_X86_64 && type == R_X86_64_64) ||
+        (ehdr->e_machine == EM_AARCH64 && type == R_AARCH64_ABS64))
+        size = 8;
+      if (!size || relas[j].r_offset + size > section->size)
+        continue;
+
+      for (int k = 0; k < size; k++)
+        (*copy)[relas[j].r_offset + k] = (uint8_t)(value >> (8 * k));
+    }
+  }
+}
+
+static bool openInputFile(struct InputFile* file, const char* path)
+{
+  memset(file, 0, sizeof(*file));
+  file->path = path;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Can't open %s: %s\n", path, xstrerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Elf64_Ehdr))
+  {
+    fprintf(stderr, "%s: not an ELF file\n", path);
+    close(fd);
+    return false;
+  }
+  file->mapSize = st.st_size;
+  file->map = mmap(0, file->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file->map == MAP_FAILED)
+  {
+    fprintf(stderr, "Can't map %s: %s\n", path, xstrerror(errno));
+    file->map = 0;
+    return false;
+  }
+
+  const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)file->map;
+  if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+    ehdr->e_ident[EI_DATA] != ELFDATA2LSB || ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > file->mapSize ||
+    ehdr->e_shstrndx >= ehdr->e_shnum)
+  {
+    fprintf(stderr, "%s: only 64-bit little-endian ELF files are supported\n", path);
+    return false;
+  }
+
+  file->isRelocatable = ehdr->e_type == ET_REL;
+
+  const Elf64_Shdr* shdrs = (const Elf64_Shdr*)((const uint8_t*)file->map + ehdr->e_shoff);
+  const char* shstrtab = (const char*)file->map + shdrs[ehdr->e_shstrndx].sh_offset;
+  size_t infoIdx = 0;
+  size_t lineIdx = 0;
+  for (size_t i = 0; i < ehdr->e_shnum; i++)
+  {
+    const char* name = shstrtab + shdrs[i].sh_name;
+    struct DebugSection* section = 0;
+    if (strcmp(name, ".debug_info") == 0)
+    {
+      section = &file->info;
+      infoIdx = i;
+    }
+    else if (strcmp(name, ".debug_abbrev") == 0)
+      section = &file->abbrev;
+    else if (strcmp(name, ".debug_str") == 0)
+      section = &file->str;
+    else if (strcmp(name, ".debug_line_str") == 0)
+      section = &file->lineStr;
+    else if (strcmp(name, ".debug_str_offsets") == 0)
+      section = &file->strOffsets;
+    else if (strcmp(name, ".debug_line") == 0)
+    {
+      section = &file->line;
+      lineIdx = i;
+    }
+    if (!section || shdrs[i].sh_type == SHT_NOBITS || shdrs[i].sh_offset + shdrs[i].sh_size > file->mapSize)
+      continue;
+    if (shdrs[i].sh_flags & SHF_COMPRESSED)
+    {
+      fprintf(stderr, "%s: compressed debug sections are not supported\n", path);
+      return false;
+    }
+
+    section->data = (const uint8_t*)file->map + shdrs[i].sh_offset;
+    section->size = shdrs[i].sh_size;
+  }
+
+  if (!file->info.data || !file->abbrev.data)
+  {
+    fprintf(stderr, "%s: no debug information found\n", path);
+    return false;
+  }
+
+  if (ehdr->e_type == ET_REL)
+  {
+    relocateSection(file, shdrs, ehdr->e_shnum, infoIdx, &file->relocated[0], &file->info);
+    if (lineIdx)
+      relocateSection(file, shdrs, ehdr->e_shnum, lineIdx, &file->relocated[1], &file->line);
+  }
+
+  return true;
+}
+
+static void closeInputFile(struct InputFile* file)
+{
+  free(file->relocated[0]);
+  free(file->relocated[1]);
+  if (file->map)
+    munmap(file->map, file->mapSize);
+}
+
+static void collectUnits(struct InputFile* file, size_t* unitCapacity)
+{
+  size_t offset = 0;
+  const uint8_t* end = file->info.data + file->info.size;
+  while (offset + 4 <= file->info.size)
+  {
+    const uint8_t* p = file->info.data + offset;
+    uint64_t length = readU(&p, end, 4);
+    if (length == 0xffffffff)
+      length = readU(&p, end, 8);
+    if (length == 0)
+      break;
+    if (!p || length > (uint64_t)(end - p))
+    {
+      fprintf(stderr, "%s: truncated DWARF unit at offset %zu\n", file->path, offset);
+      break;
+    }
+
+    if (unitCount == *unitCapacity)
+    {
+      *unitCapacity *= 2;
+      units = (struct UnitRef*)xrealloc(units, *unitCapacity * sizeof(struct UnitRef));
+    }
+    units[unitCount].file = file;
+    units[unitCount].offset = offset;
+    unitCount++;
+
+    offset = (p - file->info.data) + length;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  // Without binaries dump is just rewritten with duplicate records merged
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t fileCount = 0;
+  struct InputFile* files = (struct InputFile*)xcalloc(argc, sizeof(struct InputFile));
+  size_t unitCapacity = 256;
+  units = (struct UnitRef*)xmalloc(unitCapacity * sizeof(struct UnitRef));
+
+  for (int i = 2; i < argc; i++)
+  {
+    if (strstr(argv[i], "threads=") == argv[i])
+      threadCount = atol(argv[i] + 8);
+    else if (openInputFile(&files[fileCount], argv[i]))
+      collectUnits(&files[fileCount++], &unitCapacity);
+    else
+      closeInputFile(&files[fileCount]);
+  }
+  if (threadCount < 1)
+    threadCount = 1;
+
+  // Dump is shared with plugin, so use same locking and merging rules
+  FILE* dumpFile = openDumpFile(argv[1]);
+  struct stat dumpStat;
+  if (!dumpFile || fstat(fileno(dumpFile), &dumpStat) != 0)
+  {
+    printf("Can't open dump file %s: %s\n", argv[1], strerror(errno));
+    if (dumpFile)
+      fclose(dumpFile);
+    return 2;
+  }
+  if (dumpStat.st_size == 0)
+    storage = createRecordStorage();
+  else if ((storage = loadRecordStorage(dumpFile)) == 0)
+  {
+    printf("Can't load dump file %s: %s\n", argv[1], dumpLoadError());
+    fclose(dumpFile);
+    return 3;
+  }
+
+  recordTable = htab_create(storage->recordCount + 1024, hashRecordInfo, eqRecordInfoName, 0);
+  for (size_t i = 0; i < storage->recordCount; i++)
+  {
+    struct RecordInfo* ri = storage->records[i];
+    *htab_find_slot_with_hash(recordTable, ri->name, htab_hash_string(ri->name), INSERT) = ri;
+  }
+  instanceTable = htab_create(1024, hashInstanceCount, eqInstanceCountName, deleteInstanceCount);
+  variableTable = htab_create(1024, htab_hash_string, eqVariableKey, free);
+
+  pthread_t* threads = (pthread_t*)xmalloc(threadCount * sizeof(pthread_t));
+  for (long i = 0; i < threadCount; i++)
+    pthread_create(&threads[i], 0, worker, 0);
+  for (long i = 0; i < threadCount; i++)
+    pthread_join(threads[i], 0);
+  free(threads);
+  htab_traverse(instanceTable, applyInstanceCount, 0);
+  htab_delete(instanceTable);
+  htab_delete(variableTable);
+
+  // Merged dump is written to temporary file which replaces dump only when it
+  // is complete, so failed write doesn't lose records. Dump stays locked until
+  // rename, plugin and other rs-dwarf runs reopen replaced dump.
+  int result = 0;
+  char* tempName = concat(argv[1], ".XXXXXX", NULL);
+  const int tempFd = mkstemp(tempName);
+  FILE* tempFile = tempFd >= 0 ? fdopen(tempFd, "w") : 0;
+  if (!tempFile)
+  {
+    printf("Can't create temporary file %s: %s\n", tempName, strerror(errno));
+    if (tempFd >= 0)
+    {
+      close(tempFd);
+      unlink(tempName);
+    }
+    result = 4;
+  }
+  else
+  {
+    fchmod(tempFd, dumpStat.st_mode & 07777);
+    saveRecordStorage(tempFile, storage);
+    const bool failed = fflush(tempFile) != 0 || ferror(tempFile);
+    if (fclose(tempFile) != 0 || failed || rename(tempName, argv[1]) != 0)
+    {
+      printf("Can't write dump file %s: %s\n", argv[1], strerror(errno));
+      unlink(tempName);
+      result = 4;
+    }
+  }
+  free(tempName);
+  fclose(dumpFile);
+
+  htab_delete(recordTable);
+  deleteRecordStorage(storage);
+  for (size_t i = 0; i < fileCount; i++)
+    closeInputFile(&files[i]);
+  free(files);
+  free(units);
+  return result;
+}
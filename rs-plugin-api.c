@@ -1,8 +1,11 @@
 #include <gcc-plugin.h>
+#include <plugin-version.h>
 #include <cp/cp-tree.h>
 #include <langhooks.h>
-
-#include <sys/file.h>
+#include <flags.h>
+#include <cgraph.h>
+#include <function.h>
+#include <hashtab.h>
 
 #include "rs-common.h"
 #include "rs-plugin.h"
@@ -16,9 +19,26 @@ static bool flag_process_templates = false;
 static bool flag_print_layout = false;
 // Print all records with layout
 static bool flag_print_all = false;
+// Collect records once per program at link time
+static bool flag_lto = false;
 static const char* fileDumpName = 0;
 static FILE* fileDump = 0;
+// Records already stored in dump by other translation units
+static struct RecordIndex* dumpIndex = 0;
+// Records of this translation unit only
 static struct RecordStorage* storage = 0;
+// Records of storage by name
+static htab_t recordTable = 0;
+
+static hashval_t hashRecordInfo(const void* p)
+{
+  return htab_hash_string(((const struct RecordInfo*)p)->name);
+}
+
+static int eqRecordInfoName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct RecordInfo*)p1)->name, (const char*)p2) == 0;
+}
 
 static bool initStorage()
 {
@@ -26,32 +46,23 @@ static bool initStorage()
   // doesn't exist
   if (fileDumpName)
   {
-    if (!(fileDump = fopen(fileDumpName, "a+")))
+    if (!(fileDump = openDumpFile(fileDumpName)))
     {
       fprintf(stderr, "Can't open RecordSize dump file %s: %s\n", fileDumpName, xstrerror(errno));
       return false;
     }
-    // Lock it
-    flock(fileno(fileDump), LOCK_EX);
-    // It could happen that dump is empty because we've just created it
-    struct stat fileDumpStat;
-    fstat(fileno(fileDump), &fileDumpStat);
-    if (fileDumpStat.st_size == 0)
-    {
-      storage = createRecordStorage();
-      return true;
-    }
-    // Let's read dump otherwise
-    if ((storage = loadRecordStorage(fileDump)) == 0)
+    // We need only names of dumped records (empty index for just created
+    // dump), new records will be appended as separate block
+    if ((dumpIndex = loadRecordIndex(fileDump)) == 0)
     {
-      fprintf(stderr, "Can't read RecordSize dump file %s: I/O error or invalid data in file\n", fileDumpName);
+      fprintf(stderr, "Can't read RecordSize dump file %s: %s\n", fileDumpName, dumpLoadError());
       fclose(fileDump);
       return false;
     }
   }
-  else
-    storage = createRecordStorage();
 
+  storage = createRecordStorage();
+  recordTable = htab_create(1024, hashRecordInfo, eqRecordInfoName, 0);
   return true;
 }
 
@@ -59,24 +70,81 @@ static void finalizeStorage()
 {
   if (fileDump)
   {
-    // Clear dump file
-    ftruncate(fileno(fileDump), 0);
-    // Save updated dump
+    // Append new records, file is opened in append mode
     saveRecordStorage(fileDump, storage);
     // This will unlock dump file as well
     fclose(fileDump);
+    deleteRecordIndex(dumpIndex);
   }
 
+  htab_delete(recordTable);
   deleteRecordStorage(storage);
 }
 
-static bool isProcessed(const char* typeName)
+// There is no C++ front end in lto1, let plugin be loaded there anyway
+extern tree cp_global_trees[CPTI_MAX] __attribute__ ((weak));
+
+static struct RecordInfo* findRecord(const char* typeName)
+{
+  return (struct RecordInfo*)htab_find_with_hash(recordTable, typeName, htab_hash_string(typeName));
+}
+
+static bool isRecordDumped(const char* typeName)
+{
+  return dumpIndex && isRecordIndexed(dumpIndex, typeName);
+}
+
+// Records already dumped by other translation units aren't printed again
+static struct RecordInfo* addRecord(const tree type_decl, const tree record_type, bool print)
 {
-  for (size_t i = 0; i < storage->recordCount; i++)
-    if (strcmp(storage->records[i]->name, typeName) == 0)
-      return true;
+  struct RecordInfo* ri = createRecordInfo(type_decl, record_type);
+  estimateMinRecordSize(ri);
+
+  if (print && (flag_print_all || ri->estMinSize < ri->size))
+    printRecordInfo(stderr, ri, flag_print_layout);
+
+  appendRecordInfo(storage, ri);
+  *htab_find_slot_with_hash(recordTable, ri->name, htab_hash_string(ri->name), INSERT) = ri;
+  return ri;
+}
+
+static void processVariable(const tree var_decl)
+{
+  // We are interested only in variables defined in this translation unit
+  if (DECL_EXTERNAL(var_decl) || !TREE_STATIC(var_decl))
+    return;
+  // Inline variables and static data members of templates are defined in
+  // each translation unit using them, counting them here would multiply
+  // their instances. LTO mode and rs-dwarf count them once.
+  if (DECL_COMDAT(var_decl) || DECL_ONE_ONLY(var_decl) ||
+    (DECL_LANG_SPECIFIC(var_decl) && DECL_TEMPLATE_INSTANTIATION(var_decl)))
+    return;
+
+  // Each array element is an instance
+  size_t instanceCount = 1;
+  tree type = TREE_TYPE(var_decl);
+  while (TREE_CODE(type) == ARRAY_TYPE)
+  {
+    instanceCount *= arrayLength(type);
+    type = TREE_TYPE(type);
+  }
+
+  type = TYPE_MAIN_VARIANT(type);
+  if (!RECORD_OR_UNION_TYPE_P(type) || !COMPLETE_TYPE_P(type) || !instanceCount ||
+    !TYPE_NAME(type) || DECL_IS_BUILTIN(TYPE_NAME(type)))
+    return;
 
-  return false;
+  // Names are chained in reverse order, so variable may come before its
+  // record. We don't call processType here to walk static members only once.
+  // Dumped record is stored again to carry instance count, records with the
+  // same name are merged when dump is loaded.
+  const char* typeName = type_as_string(type, 0);
+  struct RecordInfo* ri = findRecord(typeName);
+  if (!ri && (flag_process_templates || !CLASSTYPE_TEMPLATE_INSTANTIATION(type)))
+    ri = addRecord(TYPE_NAME(type), type, !isRecordDumped(typeName));
+
+  if (ri)
+    ri->staticCount += instanceCount;
 }
 
 static void processType(const tree type)
@@ -102,37 +170,29 @@ static void processType(const tree type)
 
   tree aggregate_type = TREE_TYPE(type);
   // Here we got our aggregate with all members, but we are intersted only in
-  // records (structs, classes) and can ignore unions and enums.
-  if (TREE_CODE(aggregate_type) != RECORD_TYPE)
+  // records (structs, classes, unions) and can ignore enums.
+  if (!RECORD_OR_UNION_TYPE_P(aggregate_type))
     return;
 
   // We want to ignore forward declaration as well (they're not complete)
   if (!COMPLETE_TYPE_P(aggregate_type))
     return;
 
-  if (!isProcessed(type_as_string(aggregate_type, 0)))
-  {
-    struct RecordInfo* ri = createRecordInfo(type, aggregate_type);
-    estimateMinRecordSize(ri);
-
-    if (flag_print_all || ri->estMinSize < ri->size)
-      printRecordInfo(stderr, ri, flag_print_layout);
-
-    storage->recordCount++;
-    if (storage->recordCount > storage->recordCapacity)
-    {
-      storage->recordCapacity *= 2;
-      storage->records = (struct RecordInfo**)xrealloc(storage->records, storage->recordCapacity * sizeof(struct RecordInfo*));
-    }
+  const char* typeName = type_as_string(aggregate_type, 0);
+  if (!findRecord(typeName) && !isRecordDumped(typeName))
+    addRecord(type, aggregate_type, true);
 
-    storage->records[storage->recordCount - 1] = ri;
-  }
+  // Static data members are chained with fields. Their definitions could be
+  // in this translation unit even if record was processed before.
+  for (tree field = TYPE_FIELDS(aggregate_type); field; field = TREE_CHAIN(field))
+    if (TREE_CODE(field) == VAR_DECL)
+      processVariable(field);
 }
 
 static void processTemplate(const tree templateTree)
 {
   // We are not interested in anything except class templates
-  if (TREE_CODE(TREE_TYPE(templateTree)) != RECORD_TYPE)
+  if (!RECORD_OR_UNION_TYPE_P(TREE_TYPE(templateTree)))
    return;
 
   // TEMPLATE_DECL maintains chain of its instantiations
@@ -156,7 +216,7 @@ static void processTemplate(const tree templateTree)
 static void processName(const tree name)
 {
   // For record size calculations we are interested in TYPE_DECLs and
-  // TEMPLATE_DECLs
+  // TEMPLATE_DECLs, while VAR_DECLs tell us about records in static storage
   // We are also don't want to process builtin compiler types as we won't be
   // able to modify them
   if (DECL_IS_BUILTIN(name))
@@ -171,6 +231,9 @@ static void processName(const tree name)
     if (flag_process_templates)
       processTemplate(name);
     break;
+  case VAR_DECL:
+    processVariable(name);
+    break;
   default:;
   }
 }
@@ -216,16 +279,113 @@ static void recordsize_override_gate(void *gcc_data, void *plugin_data)
   finalizeStorage();
 }
 
-int plugin_init(struct plugin_name_args* info, struct plugin_gcc_version* ver)
+static void processLtoType(tree type, size_t instanceCount)
 {
-  // Language frontends have differences in representing AST
-  // At the moment we support only GNU C++
-  if (strcmp(lang_hooks.name, "GNU C++") != 0)
+  // Arrays multiply instances, pointed records survive but have no instances
+  for (;;)
   {
-    fprintf(stderr, "Recordsize plugin supports only GNU C++ frontend\n");
-    return 1;
+    if (TREE_CODE(type) == ARRAY_TYPE)
+      instanceCount *= arrayLength(type);
+    else if (POINTER_TYPE_P(type))
+      instanceCount = 0;
+    else
+      break;
+    type = TREE_TYPE(type);
+  }
+
+  type = TYPE_MAIN_VARIANT(type);
+  if (!RECORD_OR_UNION_TYPE_P(type) || !COMPLETE_TYPE_P(type))
+    return;
+
+  char* typeName = createRecordName(type);
+  if (!typeName)
+    return;
+  struct RecordInfo* ri = findRecord(typeName);
+  const bool isDumped = isRecordDumped(typeName);
+  free(typeName);
+
+  if (!ri)
+  {
+    // Dumped record is stored again only to carry instance count
+    if (isDumped && !instanceCount)
+      return;
+    ri = addRecord(TYPE_NAME(type), type, !isDumped);
+    // Records used by fields survive as well
+    for (tree field = TYPE_FIELDS(type); field; field = TREE_CHAIN(field))
+      if (TREE_CODE(field) == FIELD_DECL)
+        processLtoType(TREE_TYPE(field), 0);
   }
 
+  ri->staticCount += instanceCount;
+}
+
+static void processLtoFunction(const tree fn_decl)
+{
+  tree fn_type = TREE_TYPE(fn_decl);
+  processLtoType(TREE_TYPE(fn_type), 0);
+  for (tree arg = TYPE_ARG_TYPES(fn_type); arg; arg = TREE_CHAIN(arg))
+    processLtoType(TREE_VALUE(arg), 0);
+  if (TREE_CODE(fn_type) == METHOD_TYPE)
+    processLtoType(TYPE_METHOD_BASETYPE(fn_type), 0);
+
+#if defined(GCCPLUGIN_VERSION) && GCCPLUGIN_VERSION >= 4008
+  // Body could be absent for functions defined outside of LTO objects
+  struct function* fn = DECL_STRUCT_FUNCTION(fn_decl);
+  if (!fn)
+    return;
+
+  unsigned ix;
+  tree var;
+  FOR_EACH_LOCAL_DECL(fn, ix, var)
+    if (TREE_CODE(var) == VAR_DECL && !TREE_STATIC(var))
+      processLtoType(TREE_TYPE(var), 0);
+#endif
+}
+
+static void processLtoVariable(const tree var_decl)
+{
+  if (DECL_EXTERNAL(var_decl) || !TREE_STATIC(var_decl))
+    return;
+
+  processLtoType(TREE_TYPE(var_decl), 1);
+}
+
+static void recordsize_lto(void *gcc_data, void *plugin_data)
+{
+  if (!initStorage())
+    return;
+
+  // Collect records used by signatures of functions from call graph, by their
+  // local variables when bodies are loaded and by variables from variable pool
+#if defined(GCCPLUGIN_VERSION) && GCCPLUGIN_VERSION >= 4008
+  struct cgraph_node* fn;
+  FOR_EACH_FUNCTION(fn)
+#if GCCPLUGIN_VERSION >= 4009
+    processLtoFunction(fn->decl);
+#else
+    processLtoFunction(fn->symbol.decl);
+#endif
+
+  struct varpool_node* var;
+  FOR_EACH_VARIABLE(var)
+#if GCCPLUGIN_VERSION >= 4009
+    processLtoVariable(var->decl);
+#else
+    processLtoVariable(var->symbol.decl);
+#endif
+#else
+  for (struct cgraph_node* fn = cgraph_nodes; fn; fn = fn->next)
+    processLtoFunction(fn->decl);
+
+  for (struct varpool_node* var = varpool_nodes; var; var = var->next)
+    processLtoVariable(var->decl);
+#endif
+
+  finalizeStorage();
+}
+
+int plugin_init(struct plugin_name_args* info, struct plugin_gcc_version* ver)
+{
   if (info->argc)
   {
     for (int i = 0; i < info->argc; ++i)
@@ -244,10 +404,38 @@ int plugin_init(struct plugin_name_args* info, struct plugin_gcc_version* ver)
         flag_process_templates = true;
         fileDumpName = info->argv[i].value;
       }
+      if (strcmp(info->argv[i].key, "lto") == 0)
+        flag_lto = true;
     }
   }
 
   register_callback(info->base_name, PLUGIN_INFO, NULL, &recordsize_plugin_info);
+
+  // In LTO mode records are collected by lto1 only, while plugin does nothing
+  // in front end. Without it we do nothing in lto1.
+  if (strcmp(lang_hooks.name, "GNU GIMPLE") == 0)
+  {
+    // PLUGIN_ALL_IPA_PASSES_START is fired only when lto1 sees whole program
+    // and runs IPA passes itself, that is with -flto-partition=none. WPA stage
+    // of partitioned LTO runs IPA passes without firing it, and each LTRANS
+    // process sees only its own partition.
+    if (flag_lto && flag_wpa)
+      fprintf(stderr, "RecordSize LTO mode requires -flto-partition=none, records aren't collected\n");
+    else if (flag_lto && !flag_ltrans)
+      register_callback(info->base_name, PLUGIN_ALL_IPA_PASSES_START, &recordsize_lto, NULL);
+    return 0;
+  }
+  if (flag_lto)
+    return 0;
+
+  // Language frontends have differences in representing AST
+  // At the moment we support only GNU C++
+  if (strcmp(lang_hooks.name, "GNU C++") != 0)
+  {
+    fprintf(stderr, "Recordsize plugin supports only GNU C++ frontend\n");
+    return 1;
+  }
+
   register_callback(info->base_name, PLUGIN_OVERRIDE_GATE, &recordsize_override_gate, NULL);
   register_callback(info->base_name, PLUGIN_FINISH_UNIT, &recordsize_override_gate, NULL);
 
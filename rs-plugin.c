@@ -1,8 +1,16 @@
 #include "rs-plugin.h"
+#include "rs-common.h"
 
 #include <tree.h>
 #include <cp/cp-tree.h>
 #include <defaults.h>
+#include <langhooks.h>
+#include <demangle.h>
+
+#ifdef __cplusplus
+// There is no C++ front end at link time, let plugin be loaded by lto1 anyway
+extern const char* type_as_string(tree, int) __attribute__ ((weak));
+#endif
 
 enum
 {
@@ -11,6 +19,175 @@ enum
 };
 static const char* fieldNames[] = {"base/vptr", "unnamed"};
 
+// Template arguments are lost at link time, so instantiations of same
+// template are told apart by their layout: field offsets and type names
+static uint64_t layoutHash(const tree record_type)
+{
+  uint64_t hash = TYPE_SIZE(record_type) ? TREE_INT_CST_LOW(TYPE_SIZE(record_type)) : 0;
+  for (tree field = TYPE_FIELDS(record_type); field; field = TREE_CHAIN(field))
+  {
+    if (TREE_CODE(field) != FIELD_DECL)
+      continue;
+
+    hash = (hash ^ int_bit_position(field)) * 1099511628211ULL;
+    tree type = TREE_TYPE(field);
+    while (TREE_CODE(type) == ARRAY_TYPE || POINTER_TYPE_P(type))
+    {
+      hash = (hash ^ TREE_CODE(type)) * 1099511628211ULL;
+      type = TREE_TYPE(type);
+    }
+    tree typeName = TYPE_NAME(TYPE_MAIN_VARIANT(type));
+    if (typeName && TREE_CODE(typeName) == TYPE_DECL)
+      typeName = DECL_NAME(typeName);
+    hash = (hash ^ TREE_CODE(type)) * 1099511628211ULL;
+    if (typeName)
+      hash ^= hashRecordName(IDENTIFIER_POINTER(typeName));
+  }
+  return hash;
+}
+
+char* createRecordName(const tree record_type)
+{
+  // C++ front end isn't available at link time and language specific data is
+  // already freed, so we build name from type contexts there
+  if (strcmp(lang_hooks.name, "GNU GIMPLE") != 0)
+    return xstrdup(type_as_string(record_type, 0));
+
+  tree name = TYPE_NAME(record_type);
+  // Since GCC 5 types with linkage keep mangled name for ODR checks, it
+  // includes template arguments
+  if (name && TREE_CODE(name) == TYPE_DECL && DECL_ASSEMBLER_NAME_SET_P(name))
+  {
+    char* demangled = cplus_demangle(IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(name)),
+      DMGL_PARAMS | DMGL_ANSI | DMGL_TYPES);
+    if (demangled)
+      return demangled;
+  }
+  if (name && TREE_CODE(name) == TYPE_DECL)
+    name = DECL_NAME(name);
+  if (!name)
+    return 0;
+
+  char* result = xstrdup(IDENTIFIER_POINTER(name));
+  tree context = TYPE_CONTEXT(record_type);
+  while (context && TREE_CODE(context) != TRANSLATION_UNIT_DECL)
+  {
+    tree contextName = TYPE_P(context) ? TYPE_NAME(context) : DECL_NAME(context);
+    if (contextName && TREE_CODE(contextName) == TYPE_DECL)
+      contextName = DECL_NAME(contextName);
+
+    char* scoped = concat(contextName ? IDENTIFIER_POINTER(contextName) : "{anonymous}", "::", result, NULL);
+    free(result);
+    result = scoped;
+
+    context = TYPE_P(context) ? TYPE_CONTEXT(context) : DECL_CONTEXT(context);
+  }
+
+  // Records with same name and different layouts are different
+  // instantiations of one template
+  char hash[32];
+  snprintf(hash, sizeof(hash), " [%016llx]", (unsigned long long)layoutHash(record_type));
+  char* unique = concat(result, hash, NULL);
+  free(result);
+  return unique;
+}
+
+size_t arrayLength(const tree array_type)
+{
+  tree domain = TYPE_DOMAIN(array_type);
+  if (!domain || !TYPE_MIN_VALUE(domain) || !TYPE_MAX_VALUE(domain) ||
+    TREE_CODE(TYPE_MIN_VALUE(domain)) != INTEGER_CST || TREE_CODE(TYPE_MAX_VALUE(domain)) != INTEGER_CST)
+    return 0;
+
+  return TREE_INT_CST_LOW(TYPE_MAX_VALUE(domain)) - TREE_INT_CST_LOW(TYPE_MIN_VALUE(domain)) + 1;
+}
+
+// Calculate size of smallest integer type holding all enumerators, in bits.
+// Returns 0 if enumerator values are unknown or there are no enumerators (such
+// enum is used as strong typedef of its underlying type).
+static size_t enumTypeMinSize(const tree enum_type)
+{
+  int64_t minValue = 0;
+  uint64_t maxValue = 0;
+  if (!TYPE_VALUES(enum_type))
+    return 0;
+  for (tree value = TYPE_VALUES(enum_type); value; value = TREE_CHAIN(value))
+  {
+    // C++ front end chains CONST_DECLs, C front end chains values itself
+    tree cst = TREE_VALUE(value);
+    if (TREE_CODE(cst) == CONST_DECL)
+      cst = DECL_INITIAL(cst);
+    if (!cst || TREE_CODE(cst) != INTEGER_CST)
+      return 0;
+
+    if (tree_int_cst_sgn(cst) < 0)
+    {
+      const int64_t v = (int64_t)TREE_INT_CST_LOW(cst);
+      if (v < minValue)
+        minValue = v;
+    }
+    else if ((uint64_t)TREE_INT_CST_LOW(cst) > maxValue)
+      maxValue = TREE_INT_CST_LOW(cst);
+  }
+
+  return enumMinSize(minValue, maxValue);
+}
+
+// Calculate type alignment ignoring alignas() and aligned attributes of type
+// and its fields
+static size_t naturalTypeAlign(tree type)
+{
+  while (TREE_CODE(type) == ARRAY_TYPE)
+    type = TREE_TYPE(type);
+  // Typedef with aligned attribute is variant of type
+  type = TYPE_MAIN_VARIANT(type);
+  if ((TREE_CODE(type) != RECORD_TYPE && TREE_CODE(type) != UNION_TYPE) || TYPE_PACKED(type))
+    return TYPE_ALIGN(type);
+
+  size_t align = BITS_PER_UNIT;
+  for (tree field = TYPE_FIELDS(type); field; field = TREE_CHAIN(field))
+  {
+    if (TREE_CODE(field) != FIELD_DECL)
+      continue;
+    const size_t fieldAlign = DECL_BIT_FIELD(field) || DECL_PACKED(field) ? DECL_ALIGN(field) :
+      naturalTypeAlign(TREE_TYPE(field));
+    if (fieldAlign > align)
+      align = fieldAlign;
+  }
+  return align < TYPE_ALIGN(type) ? align : TYPE_ALIGN(type);
+}
+
+// Find out parts std::optional, std::pair or std::variant field would be
+// split into from wrapper template arguments
+static void flattenWrapper(struct FieldInfo* fi, const tree wrapper_type)
+{
+  tree args = INNERMOST_TEMPLATE_ARGS(CLASSTYPE_TI_ARGS(wrapper_type));
+  // Variant alternatives are packed into single argument
+  if (TREE_VEC_LENGTH(args) == 1 && ARGUMENT_PACK_P(TREE_VEC_ELT(args, 0)))
+    args = ARGUMENT_PACK_ARGS(TREE_VEC_ELT(args, 0));
+
+  const size_t count = TREE_VEC_LENGTH(args);
+  size_t* sizes = (size_t*)xmalloc((count + 1) * sizeof(size_t));
+  size_t* aligns = (size_t*)xmalloc((count + 1) * sizeof(size_t));
+  bool isComplete = true;
+  for (size_t i = 0; i < count; i++)
+  {
+    tree arg = TREE_VEC_ELT(args, i);
+    if (!TYPE_P(arg) || !TYPE_SIZE(arg) || TREE_CODE(TYPE_SIZE(arg)) != INTEGER_CST)
+    {
+      isComplete = false;
+      break;
+    }
+    sizes[i] = TREE_INT_CST_LOW(TYPE_SIZE(arg));
+    aligns[i] = TYPE_ALIGN(arg);
+  }
+  if (isComplete)
+    flattenWrapperField(fi, fi->typeName, sizes, aligns, count);
+
+  free(sizes);
+  free(aligns);
+}
+
 struct FieldInfo* createFieldInfo(const tree field_decl)
 {
   struct FieldInfo* fi = (struct FieldInfo*) xcalloc(1, sizeof(struct FieldInfo));
@@ -37,6 +214,64 @@ struct FieldInfo* createFieldInfo(const tree field_decl)
     TREE_INT_CST_LOW(DECL_FIELD_BIT_OFFSET(field_decl));
 
   fi->align = DECL_ALIGN(field_decl);
+  fi->naturalAlign = fi->align;
+  if (!fi->isBitField && !DECL_PACKED(field_decl))
+  {
+    const size_t naturalAlign = naturalTypeAlign(TREE_TYPE(field_decl));
+    if (naturalAlign < fi->align)
+      fi->naturalAlign = naturalAlign;
+  }
+
+  // Remember which record is embedded by value, so we can find out how
+  // containers would change if that record is optimized
+  tree type = TREE_TYPE(field_decl);
+  while (TREE_CODE(type) == ARRAY_TYPE)
+    type = TREE_TYPE(type);
+  if (RECORD_OR_UNION_TYPE_P(type))
+    fi->typeName = createRecordName(TYPE_MAIN_VARIANT(type));
+  if (!fi->typeName)
+    fi->typeName = xstrdup("");
+
+  fi->isBool = TREE_CODE(TREE_TYPE(field_decl)) == BOOLEAN_TYPE && !fi->isBitField;
+  // Stateless allocators/comparators/policies take byte plus padding unless
+  // they are empty bases or [[no_unique_address]] members
+  tree fieldType = TREE_TYPE(field_decl);
+  fi->isEmpty = !fi->isSpecial && TREE_CODE(fieldType) == RECORD_TYPE && TYPE_LANG_SPECIFIC(fieldType) &&
+    CLASSTYPE_EMPTY_P(fieldType);
+
+  // Find out if enum (or array of enums) would fit into smaller underlying
+  // type, bit-fields are already narrowed by user
+  if (TREE_CODE(type) == ENUMERAL_TYPE && !fi->isBitField && TYPE_SIZE(type))
+  {
+    const size_t enumSize = TREE_INT_CST_LOW(TYPE_SIZE(type));
+    const size_t minSize = enumTypeMinSize(type);
+    if (minSize && minSize < enumSize)
+    {
+      fi->enumSize = fi->size / enumSize * minSize;
+      fi->enumAlign = DECL_USER_ALIGN(field_decl) ? fi->align : minSize;
+    }
+  }
+
+  // Find out how much pointer or reference (or array of them) would take if
+  // it was replaced by 32-bit offset or index, vptr can't be replaced
+  if (POINTER_TYPE_P(type) && !fi->isSpecial && !fi->isBitField && TYPE_SIZE(type))
+  {
+    const size_t pointerSize = TREE_INT_CST_LOW(TYPE_SIZE(type));
+    if (pointerSize > COMPRESSED_POINTER_SIZE)
+    {
+      fi->pointerSize = fi->size / pointerSize * COMPRESSED_POINTER_SIZE;
+      fi->pointerAlign = DECL_USER_ALIGN(field_decl) ? fi->align : COMPRESSED_POINTER_SIZE;
+    }
+  }
+
+  // Wrapper embedded by value (not array) could have its flag hoisted into
+  // record padding
+  if (!fi->isSpecial && !fi->isBitField && TREE_CODE(fieldType) == RECORD_TYPE && isWrapperType(fi->typeName))
+  {
+    tree wrapper_type = TYPE_MAIN_VARIANT(fieldType);
+    if (TYPE_LANG_SPECIFIC(wrapper_type) && CLASSTYPE_TEMPLATE_INFO(wrapper_type))
+      flattenWrapper(fi, wrapper_type);
+  }
 
   return fi;
 }
@@ -45,12 +280,23 @@ struct RecordInfo* createRecordInfo(const tree type_decl, const tree record_type
 {
   struct RecordInfo* ri = (struct RecordInfo*) xcalloc(1, sizeof(struct RecordInfo));
 
-  ri->name = xstrdup(type_as_string(record_type, 0));
-  ri->fileName = xstrdup(DECL_SOURCE_FILE(type_decl));
-  ri->line = DECL_SOURCE_LINE(type_decl);
+  ri->name = createRecordName(record_type);
+  // At link time type name could be plain identifier without location
+  if (type_decl && TREE_CODE(type_decl) == TYPE_DECL && DECL_SOURCE_FILE(type_decl))
+  {
+    ri->fileName = xstrdup(DECL_SOURCE_FILE(type_decl));
+    ri->line = DECL_SOURCE_LINE(type_decl);
+  }
+  else
+    ri->fileName = xstrdup("");
   ri->size = TREE_INT_CST_LOW(TYPE_SIZE(record_type));
   ri->align = TYPE_ALIGN(record_type);
-  ri->isInstance = CLASSTYPE_TEMPLATE_INSTANTIATION(record_type);
+  ri->isUnion = TREE_CODE(record_type) == UNION_TYPE;
+  ri->naturalAlign = naturalTypeAlign(record_type);
+  ri->isInstance = TYPE_LANG_SPECIFIC(record_type) && CLASSTYPE_TEMPLATE_INSTANTIATION(record_type);
+  // Partial specializations are grouped with primary template, e.g.
+  // 'ns::TemplateClass<int*>' gives 'ns::TemplateClass'
+  ri->templateName = ri->isInstance ? templateFamilyName(ri->name) : xstrdup("");
   ri->firstField = SIZE_MAX;
   ri->estMinSize = SIZE_MAX;
 
@@ -95,100 +341,3 @@ struct RecordInfo* createRecordInfo(const tree type_decl, const tree record_type
 
   return ri;
 }
-
-struct RecordStorage* createRecordStorage()
-{
-  struct RecordStorage* rs = (struct RecordStorage*)xmalloc(sizeof(struct RecordStorage));
-  rs->recordCount = 0;
-  rs->recordCapacity = 256;
-  rs->records = (struct RecordInfo**)xmalloc(rs->recordCapacity * sizeof(struct RecordInfo*));
-
-  return rs;
-}
-
-void saveFieldInfo(FILE* file, const struct FieldInfo* fi)
-{
-  size_t len = strlen(fi->name);
-  fwrite(&len, sizeof(len), 1, file);
-  fwrite(fi->name, len + 1, 1, file);
-
-  fwrite(&fi->size, sizeof(fi->size), 1, file);
-  fwrite(&fi->offset, sizeof(fi->offset), 1, file);
-  fwrite(&fi->align, sizeof(fi->align), 1, file);
-
-  fwrite(&fi->isSpecial, sizeof(fi->isSpecial), 1, file);
-  fwrite(&fi->isBitField, sizeof(fi->isBitField), 1, file);
-}
-
-void saveRecordInfo(FILE* file, const struct RecordInfo* ri)
-{
-  fwrite(&ri->fieldCount, sizeof(ri->fieldCount), 1, file);
-  for (size_t i = 0; i < ri->fieldCount; i++)
-    saveFieldInfo(file, ri->fields[i]);
-
-  size_t len = strlen(ri->name);
-  fwrite(&len, sizeof(len), 1, file);
-  fwrite(ri->name, len + 1, 1, file);
-
-  len = strlen(ri->fileName);
-  fwrite(&len, sizeof(len), 1, file);
-  fwrite(ri->fileName, len + 1, 1, file);
-
-  fwrite(&ri->line, sizeof(ri->line), 1, file);
-  fwrite(&ri->size, sizeof(ri->size), 1, file);
-  fwrite(&ri->align, sizeof(ri->align), 1, file);
-
-  fwrite(&ri->firstField, sizeof(ri->firstField), 1, file);
-
-  fwrite(&ri->estMinSize, sizeof(ri->estMinSize), 1, file);
-
-  fwrite(&ri->hasBitFields, sizeof(ri->hasBitFields), 1, file);
-  fwrite(&ri->isInstance, sizeof(ri->isInstance), 1, file);
-  fwrite(&ri->hasVirtualBase, sizeof(ri->hasVirtualBase), 1, file);
-}
-
-void saveRecordStorage(FILE* file, const struct RecordStorage* rs)
-{
-  fwrite(&rs->recordCount, sizeof(rs->recordCount), 1, file);
-  for (size_t i = 0; i < rs->recordCount; i++)
-    saveRecordInfo(file, rs->records[i]);
-}
-
-void estimateMinRecordSize(struct RecordInfo* ri)
-{
-  // At the moment we can't handle some cases
-  if (ri->hasBitFields || ri->hasVirtualBase)
-    return;
-
-  // Handle records with bases only
-  if (ri->firstField == SIZE_MAX)
-  {
-    ri->estMinSize = ri->size;
-    return;
-  }
-
-  // We assume that field alignment is always power of two, so we can always reorder them
-  // to have record 'packed'
-  size_t fieldsSize = 0;
-  size_t maxFieldAlign = 0;
-  for (size_t i = ri->firstField; i < ri->fieldCount; i++)
-  {
-    fieldsSize += ri->fields[i]->size;
-    if (ri->fields[i]->align > maxFieldAlign)
-      maxFieldAlign = ri->fields[i]->align;
-  }
-
-  size_t endOfBases = 0;
-  // If we have bases there can be a need for additional padding between bases and first field
-  if (ri->firstField != 0)
-  {
-    endOfBases = ri->fields[ri->firstField - 1]->offset + ri->fields[ri->firstField - 1]->size;
-    if (endOfBases % maxFieldAlign)
-      endOfBases = (endOfBases / maxFieldAlign + 1) * maxFieldAlign;
-  }
-
-  ri->estMinSize = endOfBases + fieldsSize;
-  // Let us add final padding if needed
-  if (ri->estMinSize % ri->align)
-    ri->estMinSize = (ri->estMinSize / ri->align + 1) * ri->align;
-}
@@ -5,14 +5,12 @@
 
 #include <gcc-plugin.h>
 
+// Qualified record name, 0 for anonymous records at link time
+char* createRecordName(const tree record_type);
+// Number of elements in array, 0 if unknown
+size_t arrayLength(const tree array_type);
+
 struct FieldInfo* createFieldInfo(const tree field_decl);
 struct RecordInfo* createRecordInfo(const tree type_decl, const tree record_type);
-struct RecordStorage* createRecordStorage();
-
-void saveFieldInfo(FILE* file, const struct FieldInfo* ri);
-void saveRecordInfo(FILE* file, const struct RecordInfo* ri);
-void saveRecordStorage(FILE* file, const struct RecordStorage* rs);
-
-void estimateMinRecordSize(struct RecordInfo* ri);
 
 #endif
@@ -1,6 +1,13 @@
 #include "rs-common.h"
 
+#define HAVE_DECL_BASENAME 1
+#include <libiberty.h>
+#include <hashtab.h>
+#undef HAVE_DECL_BASENAME
+
 #include <errno.h>
+#include <fnmatch.h>
+#include <regex.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,12 +17,15 @@ enum {
   SKIP_EMPTY = 0x01,
   SKIP_GOOD = 0x02,
   SKIP_HANDLED = 0x04,
-  SKIP_TEMPLATES = 0x08
+  SKIP_TEMPLATES = 0x08,
+  SKIP_NATURAL = 0x10
 };
 
 void usage(const char* progName)
 {
-  printf("Usage: %s dumpfile [skip=eght] [sort=dns]\n", progName);
+  printf("Usage: %s dumpfile [skip=eghnt] [sort=acdhlmnprsuw] [minpad=N] [minhole=N] [minwaste=N]\n"
+    "  [minsize=N] [fields>N] [fields<N] [name=glob] [name~=regex] [file=glob] [file~=regex] [group=dot]\n"
+    "  [depth=N] [owners=file] [format=csv|jsonl] [sizeclass=glibc|jemalloc|tcmalloc|file]\n", progName);
 }
 
 int parseSkip(const char* skipSpec)
@@ -37,6 +47,9 @@ int parseSkip(const char* skipSpec)
     case 't':
       flags |= SKIP_TEMPLATES;
       break;
+    case 'n':
+      flags |= SKIP_NATURAL;
+      break;
     default:
       break;
     }
@@ -45,16 +58,93 @@ int parseSkip(const char* skipSpec)
   return flags;
 }
 
-void filterStorage(struct RecordStorage* rs, int skipFlags)
+// Shell wildcard or POSIX extended regular expression, compiled once
+struct Pattern
+{
+  const char* glob;
+  regex_t regex;
+  bool isRegex;
+};
+
+struct RecordFilter
+{
+  int skipFlags;
+  // Following limits are in bits
+  size_t minPadding;
+  size_t minHole;
+  size_t minWaste;
+  size_t minSize;
+  size_t minFields;
+  size_t maxFields;
+  struct Pattern* name;
+  struct Pattern* file;
+};
+
+struct Pattern* createPattern(const char* text, bool isRegex)
+{
+  struct Pattern* pattern = (struct Pattern*)xcalloc(1, sizeof(struct Pattern));
+  pattern->isRegex = isRegex;
+  if (!isRegex)
+  {
+    pattern->glob = text;
+    return pattern;
+  }
+
+  int error = regcomp(&pattern->regex, text, REG_EXTENDED | REG_NOSUB);
+  if (error)
+  {
+    char message[256];
+    regerror(error, &pattern->regex, message, sizeof(message));
+    printf("Invalid regular expression %s: %s\n", text, message);
+    free(pattern);
+    return 0;
+  }
+  return pattern;
+}
+
+void deletePattern(struct Pattern* pattern)
+{
+  if (!pattern)
+    return;
+  if (pattern->isRegex)
+    regfree(&pattern->regex);
+  free(pattern);
+}
+
+bool matchPattern(const struct Pattern* pattern, const char* s)
+{
+  if (pattern->isRegex)
+    return regexec(&pattern->regex, s, 0, 0, 0) == 0;
+  return fnmatch(pattern->glob, s, 0) == 0;
+}
+
+bool isFiltered(const struct RecordInfo* ri, const struct RecordFilter* filter)
+{
+  const int skipFlags = filter->skipFlags;
+  if ((skipFlags & SKIP_EMPTY && ri->fieldCount == 0) ||
+    (skipFlags & SKIP_GOOD && ri->estMinSize >= ri->size) ||
+    (skipFlags & SKIP_HANDLED && (ri->estMinSize != SIZE_MAX)) ||
+    (skipFlags & SKIP_TEMPLATES && ri->isInstance) ||
+    (skipFlags & SKIP_NATURAL && ri->naturalSize >= ri->size))
+    return true;
+
+  // Cheap numeric checks go before pattern matching
+  const size_t waste = ri->estMinSize < ri->size ? ri->size - ri->estMinSize : 0;
+  if (ri->totalPadding < filter->minPadding || ri->maxHole < filter->minHole || waste < filter->minWaste ||
+    ri->size < filter->minSize || ri->fieldCount < filter->minFields || ri->fieldCount > filter->maxFields)
+    return true;
+
+  return (filter->name && !matchPattern(filter->name, ri->name)) ||
+    (filter->file && !matchPattern(filter->file, ri->fileName));
+}
+
+void filterStorage(struct RecordStorage* rs, const struct RecordFilter* filter)
 {
   size_t lastIdx = 0;
   for (size_t i = 0; i < rs->recordCount; i++)
   {
     struct RecordInfo* ri = rs->records[i];
-    if ((skipFlags & SKIP_EMPTY && ri->fieldCount == 0) ||
-      (skipFlags & SKIP_GOOD && ri->estMinSize >= ri->size) ||
-      (skipFlags & SKIP_HANDLED && (ri->estMinSize != SIZE_MAX)) ||
-      (skipFlags & SKIP_TEMPLATES && ri->isInstance))
+    if (isFiltered(ri, filter))
       deleteRecordInfo(ri);
     else
     {
@@ -65,6 +155,1066 @@ void filterStorage(struct RecordStorage* rs, int skipFlags)
   rs->recordCount = lastIdx;
 }
 
+// Node of embedding graph. Edges are directed from embedded record to records
+// which embed it by value.
+struct EmbeddingNode
+{
+  struct RecordInfo* ri;
+  struct EmbeddingNode** embedders;
+  size_t embedderCount;
+  size_t embedderCapacity;
+  // Number of cascade which node is participating in
+  size_t cascade;
+  // Record size within current cascade, SIZE_MAX if not yet calculated
+  size_t newSize;
+};
+
+hashval_t hashEmbeddingNode(const void* p)
+{
+  return htab_hash_string(((const struct EmbeddingNode*)p)->ri->name);
+}
+
+int eqEmbeddingNodeName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct EmbeddingNode*)p1)->ri->name, (const char*)p2) == 0;
+}
+
+struct EmbeddingNode* findEmbeddingNode(htab_t nodeTable, const char* name)
+{
+  return (struct EmbeddingNode*)htab_find_with_hash(nodeTable, name, htab_hash_string(name));
+}
+
+// Map record names to nodes, first record wins if several ones share name
+htab_t createEmbeddingTable(struct RecordStorage* rs, struct EmbeddingNode* nodes)
+{
+  htab_t nodeTable = htab_create(rs->recordCount, hashEmbeddingNode, eqEmbeddingNodeName, 0);
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    nodes[i].ri = rs->records[i];
+    void** slot = htab_find_slot_with_hash(nodeTable, nodes[i].ri->name, htab_hash_string(nodes[i].ri->name), INSERT);
+    if (!*slot)
+      *slot = &nodes[i];
+  }
+  return nodeTable;
+}
+
+size_t cascadeSize(htab_t nodeTable, struct EmbeddingNode* node, size_t cascade)
+{
+  // Records which don't embed optimized record don't change
+  if (node->cascade != cascade)
+    return node->ri->size;
+  if (node->newSize != SIZE_MAX)
+    return node->newSize;
+
+  // Different records sharing same name could form a cycle, stop there
+  struct RecordInfo* ri = node->ri;
+  node->newSize = ri->size;
+
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(ri->fieldCount * sizeof(struct FieldInfo*));
+  struct FieldInfo* shrunkFields = (struct FieldInfo*)xmalloc(ri->fieldCount * sizeof(struct FieldInfo));
+  // Shrunk base moves following bases (aligned as before) closer
+  size_t baseShift = 0;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    struct FieldInfo* fi = ri->fields[i];
+    fields[i] = fi;
+    if (fi->isSpecial && baseShift && fi->align)
+    {
+      shrunkFields[i] = *fi;
+      shrunkFields[i].offset = (fi->offset - baseShift + fi->align - 1) / fi->align * fi->align;
+      fields[i] = &shrunkFields[i];
+    }
+    // Vptr has no type name
+    if (!*fi->typeName)
+      continue;
+
+    // Base trimmed by tail padding reuse is left as is
+    struct EmbeddingNode* embedded = findEmbeddingNode(nodeTable, fi->typeName);
+    if (!embedded || embedded->cascade != cascade || embedded->ri->size == 0 || fi->size % embedded->ri->size)
+      continue;
+
+    // Field can be an array of embedded records
+    shrunkFields[i] = *fields[i];
+    shrunkFields[i].size = fi->size / embedded->ri->size * cascadeSize(nodeTable, embedded, cascade);
+    fields[i] = &shrunkFields[i];
+    if (fi->isSpecial)
+      baseShift += fi->size - shrunkFields[i].size;
+  }
+
+  // Record keeps its field order, so only alignment rounding matters here
+  size_t oldLayoutSize = layoutFieldsSize(ri, ri->fields);
+  size_t newLayoutSize = layoutFieldsSize(ri, fields);
+  if (oldLayoutSize != SIZE_MAX && newLayoutSize < oldLayoutSize)
+    node->newSize = ri->size - (oldLayoutSize - newLayoutSize);
+
+  free(shrunkFields);
+  free(fields);
+  return node->newSize;
+}
+
+void computeCascadeSavings(struct RecordStorage* rs)
+{
+  struct EmbeddingNode* nodes = (struct EmbeddingNode*)xcalloc(rs->recordCount, sizeof(struct EmbeddingNode));
+  htab_t nodeTable = createEmbeddingTable(rs, nodes);
+
+  // Build embedding graph
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    struct RecordInfo* ri = rs->records[i];
+    for (size_t j = 0; j < ri->fieldCount; j++)
+    {
+      // Bases are embedded by value as well, vptr has no type name
+      struct FieldInfo* fi = ri->fields[j];
+      if (!*fi->typeName)
+        continue;
+
+      struct EmbeddingNode* embedded = findEmbeddingNode(nodeTable, fi->typeName);
+      // Record can embed same type several times, but we need only one edge
+      if (!embedded || embedded == &nodes[i] ||
+        (embedded->embedderCount && embedded->embedders[embedded->embedderCount - 1] == &nodes[i]))
+        continue;
+
+      if (embedded->embedderCount == embedded->embedderCapacity)
+      {
+        embedded->embedderCapacity = embedded->embedderCapacity ? embedded->embedderCapacity * 2 : 4;
+        embedded->embedders = (struct EmbeddingNode**)xrealloc(embedded->embedders,
+          embedded->embedderCapacity * sizeof(struct EmbeddingNode*));
+      }
+      embedded->embedders[embedded->embedderCount++] = &nodes[i];
+    }
+  }
+
+  // Optimize each oversized record in turn and see how its embedders shrink
+  size_t markedCapacity = 16;
+  struct EmbeddingNode** marked = (struct EmbeddingNode**)xmalloc(markedCapacity * sizeof(struct EmbeddingNode*));
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    struct RecordInfo* ri = rs->records[i];
+    if (ri->estMinSize >= ri->size)
+      continue;
+
+    const size_t cascade = i + 1;
+    nodes[i].cascade = cascade;
+    nodes[i].newSize = ri->estMinSize;
+    ri->cascadeSaving = ri->size - ri->estMinSize;
+
+    // Mark all direct and transitive embedders
+    size_t markedCount = 0;
+    marked[markedCount++] = &nodes[i];
+    for (size_t m = 0; m < markedCount; m++)
+    {
+      for (size_t j = 0; j < marked[m]->embedderCount; j++)
+      {
+        struct EmbeddingNode* embedder = marked[m]->embedders[j];
+        if (embedder->cascade == cascade)
+          continue;
+
+        embedder->cascade = cascade;
+        embedder->newSize = SIZE_MAX;
+        if (markedCount == markedCapacity)
+        {
+          markedCapacity *= 2;
+          marked = (struct EmbeddingNode**)xrealloc(marked, markedCapacity * sizeof(struct EmbeddingNode*));
+        }
+        marked[markedCount++] = embedder;
+      }
+    }
+
+    for (size_t m = 1; m < markedCount; m++)
+      ri->cascadeSaving += marked[m]->ri->size - cascadeSize(nodeTable, marked[m], cascade);
+  }
+
+  free(marked);
+  for (size_t i = 0; i < rs->recordCount; i++)
+    free(nodes[i].embedders);
+  htab_delete(nodeTable);
+  free(nodes);
+}
+
+// Natural size is stored in newSize, SIZE_MAX if not yet calculated
+size_t nestedNaturalSize(htab_t nodeTable, struct EmbeddingNode* node)
+{
+  if (node->newSize != SIZE_MAX)
+    return node->newSize;
+
+  // Different records sharing same name could form a cycle, stop there
+  struct RecordInfo* ri = node->ri;
+  node->newSize = ri->naturalSize;
+
+  size_t* sizes = (size_t*)xmalloc(ri->fieldCount * sizeof(size_t));
+  bool isShrunk = false;
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    struct FieldInfo* fi = ri->fields[i];
+    sizes[i] = fi->size;
+    if (!*fi->typeName)
+      continue;
+
+    // Base could be trimmed by tail padding reuse, leave it as is then
+    struct EmbeddingNode* embedded = findEmbeddingNode(nodeTable, fi->typeName);
+    if (!embedded || embedded->ri->size == 0 || fi->size % embedded->ri->size)
+      continue;
+
+    // Field can be an array of embedded records
+    const size_t naturalSize = nestedNaturalSize(nodeTable, embedded);
+    if (naturalSize < embedded->ri->size)
+    {
+      sizes[i] = fi->size / embedded->ri->size * naturalSize;
+      isShrunk = true;
+    }
+  }
+  if (isShrunk)
+    node->newSize = layoutNaturalSize(ri, sizes);
+
+  free(sizes);
+  return node->newSize;
+}
+
+// Natural size of record is calculated from its own layout only, while
+// embedded over-aligned records inflate it as well
+void computeNestedNaturalSizes(struct RecordStorage* rs)
+{
+  struct EmbeddingNode* nodes = (struct EmbeddingNode*)xcalloc(rs->recordCount, sizeof(struct EmbeddingNode));
+  htab_t nodeTable = createEmbeddingTable(rs, nodes);
+  for (size_t i = 0; i < rs->recordCount; i++)
+    nodes[i].newSize = SIZE_MAX;
+
+  for (size_t i = 0; i < rs->recordCount; i++)
+    nestedNaturalSize(nodeTable, &nodes[i]);
+  for (size_t i = 0; i < rs->recordCount; i++)
+    rs->records[i]->naturalSize = nodes[i].newSize;
+
+  htab_delete(nodeTable);
+  free(nodes);
+}
+
+// Instantiations of one class template
+struct TemplateFamily
+{
+  const char* name;
+  struct RecordInfo** records;
+  size_t recordCount;
+  size_t recordCapacity;
+  // Bytes saved if all instantiations are optimized
+  size_t waste;
+};
+
+hashval_t hashTemplateFamily(const void* p)
+{
+  return htab_hash_string(((const struct TemplateFamily*)p)->name);
+}
+
+int eqTemplateFamilyName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct TemplateFamily*)p1)->name, (const char*)p2) == 0;
+}
+
+int compare_family(const void* p1, const void* p2)
+{
+  const struct TemplateFamily* tf1 = *(const struct TemplateFamily**)p1;
+  const struct TemplateFamily* tf2 = *(const struct TemplateFamily**)p2;
+
+  if (tf1->waste > tf2->waste)
+    return -1;
+  else if (tf1->waste < tf2->waste)
+    return 1;
+
+  return strcmp(tf1->name, tf2->name);
+}
+
+// Lay out record with its fields (except bases/vptr) taken in given order by
+// name. Returns SIZE_MAX if record fields don't match the order.
+size_t layoutInOrder(const struct RecordInfo* ri, const char** order, size_t orderSize, struct FieldInfo** fields,
+  bool* used)
+{
+  if (ri->firstField == SIZE_MAX || ri->fieldCount - ri->firstField != orderSize)
+    return SIZE_MAX;
+
+  memset(used, 0, ri->fieldCount * sizeof(bool));
+  for (size_t i = 0; i < ri->firstField; i++)
+    fields[i] = ri->fields[i];
+  for (size_t i = 0; i < orderSize; i++)
+  {
+    size_t j = ri->firstField;
+    while (j < ri->fieldCount && (used[j] || strcmp(ri->fields[j]->name, order[i]) != 0))
+      j++;
+    if (j == ri->fieldCount)
+      return SIZE_MAX;
+
+    used[j] = true;
+    fields[ri->firstField + i] = ri->fields[j];
+  }
+
+  return layoutFieldsSize(ri, fields);
+}
+
+// Find member order which gives minimal total size of all instantiations
+// sharing member set with first one. Candidates are declaration order and
+// decreasing alignment order of each instantiation.
+void printFamilyMemberOrder(const struct TemplateFamily* tf)
+{
+  const struct RecordInfo* ref = 0;
+  for (size_t i = 0; i < tf->recordCount && !ref; i++)
+  {
+    const struct RecordInfo* ri = tf->records[i];
+    if (ri->firstField != SIZE_MAX && layoutFieldsSize(ri, ri->fields) != SIZE_MAX)
+      ref = ri;
+  }
+  if (!ref)
+    return;
+
+  const size_t orderSize = ref->fieldCount - ref->firstField;
+  size_t maxFieldCount = 0;
+  for (size_t i = 0; i < tf->recordCount; i++)
+    if (tf->records[i]->fieldCount > maxFieldCount)
+      maxFieldCount = tf->records[i]->fieldCount;
+
+  const char** declOrder = (const char**)xmalloc(orderSize * sizeof(const char*));
+  const char** order = (const char**)xmalloc(orderSize * sizeof(const char*));
+  const char** bestOrder = (const char**)xmalloc(orderSize * sizeof(const char*));
+  struct FieldInfo** fields = (struct FieldInfo**)xmalloc(maxFieldCount * sizeof(struct FieldInfo*));
+  struct FieldInfo** sorted = (struct FieldInfo**)xmalloc(maxFieldCount * sizeof(struct FieldInfo*));
+  bool* used = (bool*)xmalloc(maxFieldCount * sizeof(bool));
+  for (size_t i = 0; i < orderSize; i++)
+    declOrder[i] = ref->fields[ref->firstField + i]->name;
+
+  // Only instantiations which match declaration order of reference one take
+  // part in evaluation
+  size_t declTotal = 0;
+  for (size_t i = 0; i < tf->recordCount; i++)
+  {
+    size_t size = layoutInOrder(tf->records[i], declOrder, orderSize, fields, used);
+    if (size != SIZE_MAX)
+      declTotal += size;
+  }
+  size_t bestTotal = declTotal;
+  memcpy(bestOrder, declOrder, orderSize * sizeof(const char*));
+
+  for (size_t i = 0; i < tf->recordCount; i++)
+  {
+    const struct RecordInfo* candidate = tf->records[i];
+    if (layoutInOrder(candidate, declOrder, orderSize, fields, used) == SIZE_MAX)
+      continue;
+
+    // Stable insertion sort by decreasing alignment
+    for (size_t j = 0; j < orderSize; j++)
+    {
+      struct FieldInfo* fi = candidate->fields[candidate->firstField + j];
+      size_t k = j;
+      while (k > 0 && sorted[k - 1]->align < fi->align)
+      {
+        sorted[k] = sorted[k - 1];
+        k--;
+      }
+      sorted[k] = fi;
+    }
+    for (size_t j = 0; j < orderSize; j++)
+      order[j] = sorted[j]->name;
+
+    size_t total = 0;
+    for (size_t j = 0; j < tf->recordCount; j++)
+    {
+      size_t size = layoutInOrder(tf->records[j], order, orderSize, fields, used);
+      if (size != SIZE_MAX)
+        total += size;
+    }
+    if (total < bestTotal)
+    {
+      bestTotal = total;
+      memcpy(bestOrder, order, orderSize * sizeof(const char*));
+    }
+  }
+
+  if (bestTotal < declTotal)
+  {
+    printf("  Suggested member order:");
+    for (size_t i = 0; i < orderSize; i++)
+      printf("%s %s", i ? "," : "", bestOrder[i]);
+    printf("\n  Total size of instantiations is %zu byte(s) instead of %zu byte(s)\n", bestTotal / 8,
+      declTotal / 8);
+  }
+
+  free(used);
+  free(sorted);
+  free(fields);
+  free(bestOrder);
+  free(order);
+  free(declOrder);
+}
+
+void printTemplateFamilies(struct RecordStorage* rs)
+{
+  htab_t familyTable = htab_create(64, hashTemplateFamily, eqTemplateFamilyName, 0);
+  size_t familyCount = 0;
+  size_t familyCapacity = 64;
+  struct TemplateFamily** families = (struct TemplateFamily**)xmalloc(familyCapacity * sizeof(struct TemplateFamily*));
+
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    struct RecordInfo* ri = rs->records[i];
+    if (!*ri->templateName)
+      continue;
+
+    void** slot = htab_find_slot_with_hash(familyTable, ri->templateName, htab_hash_string(ri->templateName), INSERT);
+    if (!*slot)
+    {
+      if (familyCount == familyCapacity)
+      {
+        familyCapacity *= 2;
+        families = (struct TemplateFamily**)xrealloc(families, familyCapacity * sizeof(struct TemplateFamily*));
+      }
+      struct TemplateFamily* tf = (struct TemplateFamily*)xcalloc(1, sizeof(struct TemplateFamily));
+      tf->name = ri->templateName;
+      families[familyCount++] = tf;
+      *slot = tf;
+    }
+
+    struct TemplateFamily* tf = (struct TemplateFamily*)*slot;
+    if (tf->recordCount == tf->recordCapacity)
+    {
+      tf->recordCapacity = tf->recordCapacity ? tf->recordCapacity * 2 : 4;
+      tf->records = (struct RecordInfo**)xrealloc(tf->records, tf->recordCapacity * sizeof(struct RecordInfo*));
+    }
+    tf->records[tf->recordCount++] = ri;
+    if (ri->estMinSize < ri->size)
+      tf->waste += ri->size - ri->estMinSize;
+  }
+  htab_delete(familyTable);
+
+  qsort(families, familyCount, sizeof(struct TemplateFamily*), compare_family);
+  for (size_t i = 0; i < familyCount; i++)
+  {
+    struct TemplateFamily* tf = families[i];
+    size_t oversizedCount = 0;
+    for (size_t j = 0; j < tf->recordCount; j++)
+      if (tf->records[j]->estMinSize < tf->records[j]->size)
+        oversizedCount++;
+
+    printf("Template %s: %zu instantiation(s), %zu oversized, %zu byte(s) can be saved\n", tf->name,
+      tf->recordCount, oversizedCount, tf->waste / 8);
+    // Instantiation names tell which template arguments cause padding
+    for (size_t j = 0; j < tf->recordCount; j++)
+    {
+      const struct RecordInfo* ri = tf->records[j];
+      if (ri->estMinSize < ri->size)
+        printf("  %s: size %zu byte(s), estimated minimal size %zu byte(s)\n", ri->name, ri->size / 8,
+          ri->estMinSize / 8);
+    }
+    printFamilyMemberOrder(tf);
+
+    free(tf->records);
+    free(tf);
+  }
+  free(families);
+}
+
+// Records rolled up by source directory or owner
+struct WasteGroup
+{
+  char* name;
+  size_t recordCount;
+  size_t oversizedCount;
+  // Bytes saved if one object of each record is optimized
+  size_t waste;
+  // Bytes saved in static storage
+  size_t staticWaste;
+};
+
+// Source file resolved to its group, so each file path is parsed once
+struct FileGroup
+{
+  const char* fileName;
+  struct WasteGroup* group;
+};
+
+struct OwnerMapping
+{
+  char* prefix;
+  char* owner;
+};
+
+hashval_t hashWasteGroup(const void* p)
+{
+  return htab_hash_string(((const struct WasteGroup*)p)->name);
+}
+
+int eqWasteGroupName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct WasteGroup*)p1)->name, (const char*)p2) == 0;
+}
+
+hashval_t hashFileGroup(const void* p)
+{
+  return htab_hash_string(((const struct FileGroup*)p)->fileName);
+}
+
+int eqFileGroupName(const void* p1, const void* p2)
+{
+  return strcmp(((const struct FileGroup*)p1)->fileName, (const char*)p2) == 0;
+}
+
+int compare_group(const void* p1, const void* p2)
+{
+  const struct WasteGroup* wg1 = *(const struct WasteGroup**)p1;
+  const struct WasteGroup* wg2 = *(const struct WasteGroup**)p2;
+
+  if (wg1->waste > wg2->waste)
+    return -1;
+  else if (wg1->waste < wg2->waste)
+    return 1;
+
+  return strcmp(wg1->name, wg2->name);
+}
+
+// Read 'path-prefix owner' lines, empty lines and lines starting with '#' are
+// ignored. Returns false on I/O error.
+bool loadOwnerMappings(const char* fileName, struct OwnerMapping** mappings, size_t* mappingCount)
+{
+  FILE* file = fopen(fileName, "r");
+  if (!file)
+    return false;
+
+  size_t capacity = 16;
+  *mappings = (struct OwnerMapping*)xmalloc(capacity * sizeof(struct OwnerMapping));
+  *mappingCount = 0;
+  char line[4096];
+  while (fgets(line, sizeof(line), file))
+  {
+    char* prefix = strtok(line, " \t\r\n");
+    char* owner = strtok(0, " \t\r\n");
+    if (!prefix || *prefix == '#' || !owner)
+      continue;
+
+    if (*mappingCount == capacity)
+    {
+      capacity *= 2;
+      *mappings = (struct OwnerMapping*)xrealloc(*mappings, capacity * sizeof(struct OwnerMapping));
+    }
+    (*mappings)[*mappingCount].prefix = xstrdup(prefix);
+    (*mappings)[*mappingCount].owner = xstrdup(owner);
+    (*mappingCount)++;
+  }
+
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+// Group name is owner with longest matching path prefix if mappings are
+// given, otherwise first 'depth' directories of path
+char* groupName(const char* fileName, size_t depth, const struct OwnerMapping* mappings, size_t mappingCount)
+{
+  if (!*fileName)
+    return xstrdup("<unknown>");
+
+  if (mappings)
+  {
+    const struct OwnerMapping* best = 0;
+    size_t bestLen = 0;
+    for (size_t i = 0; i < mappingCount; i++)
+    {
+      // Prefix matches whole path components only: 'src/net' doesn't own
+      // 'src/network/...'
+      const char* prefix = mappings[i].prefix;
+      const size_t len = strlen(prefix);
+      if (len >= bestLen && strncmp(fileName, prefix, len) == 0 &&
+        (!fileName[len] || fileName[len] == '/' || (len && prefix[len - 1] == '/')))
+      {
+        best = &mappings[i];
+        bestLen = len;
+      }
+    }
+    return xstrdup(best ? best->owner : "<unowned>");
+  }
+
+  // Leading slash of absolute path doesn't start a component
+  const char* end = fileName + (*fileName == '/');
+  const char* lastSlash = strrchr(fileName, '/');
+  if (!lastSlash || lastSlash < end)
+    return xstrdup(".");
+  for (size_t level = 0; level < depth; level++)
+  {
+    const char* slash = strchr(end, '/');
+    if (!slash || slash > lastSlash)
+      break;
+    end = slash + 1;
+  }
+
+  // Don't include trailing slash
+  size_t len = end - fileName;
+  if (len > 1)
+    len--;
+  char* name = (char*)xmalloc(len + 1);
+  memcpy(name, fileName, len);
+  name[len] = 0;
+  return name;
+}
+
+void printWasteGroups(struct RecordStorage* rs, size_t depth, const struct OwnerMapping* mappings,
+  size_t mappingCount)
+{
+  htab_t groupTable = htab_create(64, hashWasteGroup, eqWasteGroupName, 0);
+  htab_t fileTable = htab_create(1024, hashFileGroup, eqFileGroupName, free);
+  size_t groupCount = 0;
+  size_t groupCapacity = 64;
+  struct WasteGroup** groups = (struct WasteGroup**)xmalloc(groupCapacity * sizeof(struct WasteGroup*));
+
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    const struct RecordInfo* ri = rs->records[i];
+
+    void** fileSlot = htab_find_slot_with_hash(fileTable, ri->fileName, htab_hash_string(ri->fileName), INSERT);
+    if (!*fileSlot)
+    {
+      char* name = groupName(ri->fileName, depth, mappings, mappingCount);
+      void** slot = htab_find_slot_with_hash(groupTable, name, htab_hash_string(name), INSERT);
+      if (!*slot)
+      {
+        if (groupCount == groupCapacity)
+        {
+          groupCapacity *= 2;
+          groups = (struct WasteGroup**)xrealloc(groups, groupCapacity * sizeof(struct WasteGroup*));
+        }
+        struct WasteGroup* wg = (struct WasteGroup*)xcalloc(1, sizeof(struct WasteGroup));
+        wg->name = name;
+        groups[groupCount++] = wg;
+        *slot = wg;
+      }
+      else
+        free(name);
+
+      struct FileGroup* fg = (struct FileGroup*)xmalloc(sizeof(struct FileGroup));
+      fg->fileName = ri->fileName;
+      fg->group = (struct WasteGroup*)*slot;
+      *fileSlot = fg;
+    }
+
+    struct WasteGroup* wg = ((struct FileGroup*)*fileSlot)->group;
+    wg->recordCount++;
+    if (ri->estMinSize < ri->size)
+    {
+      wg->oversizedCount++;
+      wg->waste += ri->size - ri->estMinSize;
+      wg->staticWaste += ri->staticCount * (ri->size - ri->estMinSize);
+    }
+  }
+  htab_delete(fileTable);
+  htab_delete(groupTable);
+
+  qsort(groups, groupCount, sizeof(struct WasteGroup*), compare_group);
+  for (size_t i = 0; i < groupCount; i++)
+  {
+    struct WasteGroup* wg = groups[i];
+    printf("Group %s: %zu record(s), %zu oversized, %zu byte(s) per object set can be saved, "
+      "%zu byte(s) in static storage\n", wg->name, wg->recordCount, wg->oversizedCount, wg->waste / 8,
+      wg->staticWaste / 8);
+    free(wg->name);
+    free(wg);
+  }
+  free(groups);
+}
+
+// Allocator size classes in bytes, ascending. Request plus per-allocation
+// overhead is rounded up to smallest class holding it, requests larger than
+// largest class are rounded up to page size.
+struct SizeClassTable
+{
+  size_t* sizes;
+  size_t count;
+  size_t capacity;
+  size_t overhead;
+  size_t pageSize;
+};
+
+// gperftools tcmalloc classes for 8K pages
+static const size_t tcmallocSizes[] =
+{
+  8, 16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+  288, 320, 352, 384, 416, 448, 480, 512, 576, 640, 704, 768, 896, 1024, 1152,
+  1280, 1408, 1536, 1792, 2048, 2304, 2560, 2816, 3072, 3328, 4096, 4608, 5120,
+  6144, 6656, 8192, 9216, 10240, 12288, 13568, 14336, 16384, 20480, 24576,
+  26624, 32768, 40960, 49152, 57344, 65536, 73728, 81920, 90112, 98304, 106496,
+  114688, 122880, 131072, 139264, 147456, 155648, 163840, 172032, 180224,
+  188416, 196608, 204800, 212992, 221184, 229376, 237568, 245760, 253952, 262144
+};
+
+void appendSizeClass(struct SizeClassTable* table, size_t size)
+{
+  if (table->count == table->capacity)
+  {
+    table->capacity = table->capacity ? table->capacity * 2 : 256;
+    table->sizes = (size_t*)xrealloc(table->sizes, table->capacity * sizeof(size_t));
+  }
+  table->sizes[table->count++] = size;
+}
+
+int compare_class(const void* p1, const void* p2)
+{
+  const size_t s1 = *(const size_t*)p1;
+  const size_t s2 = *(const size_t*)p2;
+  return s1 < s2 ? -1 : s1 > s2;
+}
+
+void deleteSizeClassTable(struct SizeClassTable* table)
+{
+  if (!table)
+    return;
+  free(table->sizes);
+  free(table);
+}
+
+// Create built-in table (glibc, jemalloc or tcmalloc) or read one from file
+// with size class per line, '#' starts comment. Returns 0 on I/O error or if
+// file has no classes.
+struct SizeClassTable* createSizeClassTable(const char* spec)
+{
+  struct SizeClassTable* table = (struct SizeClassTable*)xcalloc(1, sizeof(struct SizeClassTable));
+  table->pageSize = 4096;
+
+  if (strcmp(spec, "glibc") == 0)
+  {
+    // 64-bit chunks have 8-byte size header, are 16-byte aligned and at least
+    // 32 bytes long. Requests above mmap threshold are mapped by pages.
+    table->overhead = 8;
+    for (size_t size = 32; size <= 128 * 1024; size += 16)
+      appendSizeClass(table, size);
+    return table;
+  }
+
+  if (strcmp(spec, "jemalloc") == 0)
+  {
+    // Quantum spaced classes up to 128 bytes, then four classes per doubling
+    appendSizeClass(table, 8);
+    for (size_t size = 16; size <= 128; size += 16)
+      appendSizeClass(table, size);
+    for (size_t base = 128; base < 4 * 1024 * 1024; base *= 2)
+      for (size_t step = 1; step <= 4; step++)
+        appendSizeClass(table, base + step * base / 4);
+    return table;
+  }
+
+  if (strcmp(spec, "tcmalloc") == 0)
+  {
+    table->pageSize = 8192;
+    for (size_t i = 0; i < sizeof(tcmallocSizes) / sizeof(tcmallocSizes[0]); i++)
+      appendSizeClass(table, tcmallocSizes[i]);
+    return table;
+  }
+
+  FILE* file = fopen(spec, "r");
+  if (!file)
+  {
+    deleteSizeClassTable(table);
+    return 0;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file))
+  {
+    char* size = strtok(line, " \t\r\n");
+    if (size && *size != '#' && strtoul(size, 0, 10))
+      appendSizeClass(table, strtoul(size, 0, 10));
+  }
+  const bool ok = !ferror(file) && table->count;
+  fclose(file);
+  if (!ok)
+  {
+    deleteSizeClassTable(table);
+    return 0;
+  }
+
+  qsort(table->sizes, table->count, sizeof(size_t), compare_class);
+  return table;
+}
+
+// Bytes taken by heap allocation of given size (in bits)
+size_t allocationSize(const struct SizeClassTable* table, size_t size)
+{
+  const size_t request = (size + 7) / 8 + table->overhead;
+  size_t low = 0;
+  size_t high = table->count;
+  while (low < high)
+  {
+    const size_t middle = low + (high - low) / 2;
+    if (table->sizes[middle] < request)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (low < table->count)
+    return table->sizes[low];
+  return (request + table->pageSize - 1) / table->pageSize * table->pageSize;
+}
+
+// Output is formatted into big buffer by hand, because fprintf() per value is
+// too slow for dumps with 100k records
+struct OutputBuffer
+{
+  FILE* file;
+  char* data;
+  size_t size;
+  size_t capacity;
+  // Short write happened (full disk, closed pipe), further output is dropped
+  bool failed;
+};
+
+void flushOutput(struct OutputBuffer* out)
+{
+  if (!out->failed && fwrite(out->data, 1, out->size, out->file) != out->size)
+    out->failed = true;
+  out->size = 0;
+}
+
+void putData(struct OutputBuffer* out, const char* data, size_t len)
+{
+  if (out->size + len > out->capacity)
+  {
+    flushOutput(out);
+    // Data longer than buffer goes directly
+    if (len > out->capacity)
+    {
+      if (!out->failed && fwrite(data, 1, len, out->file) != len)
+        out->failed = true;
+      return;
+    }
+  }
+  memcpy(out->data + out->size, data, len);
+  out->size += len;
+}
+
+// Truncated report (full disk, closed pipe) must not look successful. Returns
+// exit status.
+int finishOutput()
+{
+  if (fflush(stdout) != 0 || ferror(stdout))
+  {
+    fprintf(stderr, "Can't write report: %s\n", strerror(errno));
+    return 4;
+  }
+  return 0;
+}
+
+void putString(struct OutputBuffer* out, const char* s)
+{
+  putData(out, s, strlen(s));
+}
+
+void putUInt(struct OutputBuffer* out, size_t value)
+{
+  char digits[24];
+  char* p = digits + sizeof(digits);
+  do
+  {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  putData(out, p, digits + sizeof(digits) - p);
+}
+
+void putBool(struct OutputBuffer* out, bool value)
+{
+  putString(out, value ? "true" : "false");
+}
+
+// Print estimation result, unknown one is printed as JSON null/empty CSV cell
+void putEstimate(struct OutputBuffer* out, size_t value, const char* unknown)
+{
+  if (value == SIZE_MAX)
+    putString(out, unknown);
+  else
+    putUInt(out, value);
+}
+
+void putJsonString(struct OutputBuffer* out, const char* s)
+{
+  putData(out, "\"", 1);
+  const char* run = s;
+  for (; *s; s++)
+  {
+    const unsigned char c = *s;
+    if (c != '"' && c != '\\' && c >= 0x20)
+      continue;
+
+    putData(out, run, s - run);
+    run = s + 1;
+    if (c == '"' || c == '\\')
+    {
+      const char escaped[2] = {'\\', (char)c};
+      putData(out, escaped, 2);
+    }
+    else
+    {
+      const char* hex = "0123456789abcdef";
+      const char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+      putData(out, escaped, 6);
+    }
+  }
+  putData(out, run, s - run);
+  putData(out, "\"", 1);
+}
+
+void putCsvString(struct OutputBuffer* out, const char* s)
+{
+  // Template names contain commas, so strings are always quoted
+  putData(out, "\"", 1);
+  const char* run = s;
+  for (; *s; s++)
+    if (*s == '"')
+    {
+      putData(out, run, s - run + 1);
+      run = s;
+    }
+  putData(out, run, s - run);
+  putData(out, "\"", 1);
+}
+
+void putJsonRecord(struct OutputBuffer* out, const struct RecordInfo* ri)
+{
+  putString(out, "{\"name\":");
+  putJsonString(out, ri->name);
+  putString(out, ",\"file\":");
+  putJsonString(out, ri->fileName);
+  putString(out, ",\"line\":");
+  putUInt(out, ri->line);
+  putString(out, ",\"template\":");
+  putJsonString(out, ri->templateName);
+  putString(out, ",\"size\":");
+  putUInt(out, ri->size);
+  putString(out, ",\"align\":");
+  putUInt(out, ri->align);
+  putString(out, ",\"naturalAlign\":");
+  putUInt(out, ri->naturalAlign);
+  putString(out, ",\"estMinSize\":");
+  putEstimate(out, ri->estMinSize, "null");
+  putString(out, ",\"estEnumMinSize\":");
+  putEstimate(out, ri->estEnumMinSize, "null");
+  putString(out, ",\"estBoolMinSize\":");
+  putEstimate(out, ri->estBoolMinSize, "null");
+  putString(out, ",\"estEmptyMinSize\":");
+  putEstimate(out, ri->estEmptyMinSize, "null");
+  putString(out, ",\"estPointerMinSize\":");
+  putEstimate(out, ri->estPointerMinSize, "null");
+  putString(out, ",\"estFlatMinSize\":");
+  putEstimate(out, ri->estFlatMinSize, "null");
+  putString(out, ",\"naturalSize\":");
+  putEstimate(out, ri->naturalSize, "null");
+  putString(out, ",\"hasBitFields\":");
+  putBool(out, ri->hasBitFields);
+  putString(out, ",\"isInstance\":");
+  putBool(out, ri->isInstance);
+  putString(out, ",\"hasVirtualBase\":");
+  putBool(out, ri->hasVirtualBase);
+  putString(out, ",\"isUnion\":");
+  putBool(out, ri->isUnion);
+  putString(out, ",\"staticCount\":");
+  putUInt(out, ri->staticCount);
+  putString(out, ",\"cascadeSaving\":");
+  putUInt(out, ri->cascadeSaving);
+  putString(out, ",\"totalPadding\":");
+  putUInt(out, ri->totalPadding);
+  putString(out, ",\"maxHole\":");
+  putUInt(out, ri->maxHole);
+  // Allocation sizes are known only if size classes are given
+  putString(out, ",\"allocSize\":");
+  if (ri->allocSize)
+    putUInt(out, ri->allocSize);
+  else
+    putString(out, "null");
+  putString(out, ",\"allocMinSize\":");
+  if (ri->allocSize)
+    putUInt(out, ri->allocMinSize);
+  else
+    putString(out, "null");
+  putString(out, ",\"fields\":[");
+  for (size_t i = 0; i < ri->fieldCount; i++)
+  {
+    const struct FieldInfo* fi = ri->fields[i];
+    putString(out, i ? ",{\"name\":" : "{\"name\":");
+    putJsonString(out, fi->name);
+    putString(out, ",\"type\":");
+    putJsonString(out, fi->typeName);
+    putString(out, ",\"offset\":");
+    putUInt(out, fi->offset);
+    putString(out, ",\"size\":");
+    putUInt(out, fi->size);
+    putString(out, ",\"align\":");
+    putUInt(out, fi->align);
+    putString(out, ",\"naturalAlign\":");
+    putUInt(out, fi->naturalAlign);
+    putString(out, ",\"enumSize\":");
+    putUInt(out, fi->enumSize);
+    putString(out, ",\"pointerSize\":");
+    putUInt(out, fi->pointerSize);
+    putString(out, ",\"isWrapper\":");
+    putBool(out, fi->flatCount != 0);
+    putString(out, ",\"isSpecial\":");
+    putBool(out, fi->isSpecial);
+    putString(out, ",\"isBitField\":");
+    putBool(out, fi->isBitField);
+    putString(out, ",\"isBool\":");
+    putBool(out, fi->isBool);
+    putString(out, ",\"isEmpty\":");
+    putBool(out, fi->isEmpty);
+    putString(out, "}");
+  }
+  putString(out, "]}\n");
+}
+
+void putCsvHeader(struct OutputBuffer* out)
+{
+  putString(out, "record,file,line,template,size,align,estMinSize,staticCount,totalPadding,maxHole,"
+    "field,fieldName,fieldType,offset,fieldSize,fieldAlign,isSpecial,isBitField\n");
+}
+
+// One row per field, record columns are repeated. Record without fields
+// gets single row with empty field columns.
+void putCsvRecord(struct OutputBuffer* out, const struct RecordInfo* ri)
+{
+  size_t i = 0;
+  do
+  {
+    putCsvString(out, ri->name);
+    putData(out, ",", 1);
+    putCsvString(out, ri->fileName);
+    putData(out, ",", 1);
+    putUInt(out, ri->line);
+    putData(out, ",", 1);
+    putCsvString(out, ri->templateName);
+    putData(out, ",", 1);
+    putUInt(out, ri->size);
+    putData(out, ",", 1);
+    putUInt(out, ri->align);
+    putData(out, ",", 1);
+    putEstimate(out, ri->estMinSize, "");
+    putData(out, ",", 1);
+    putUInt(out, ri->staticCount);
+    putData(out, ",", 1);
+    putUInt(out, ri->totalPadding);
+    putData(out, ",", 1);
+    putUInt(out, ri->maxHole);
+    if (i < ri->fieldCount)
+    {
+      const struct FieldInfo* fi = ri->fields[i];
+      putData(out, ",", 1);
+      putUInt(out, i);
+      putData(out, ",", 1);
+      putCsvString(out, fi->name);
+      putData(out, ",", 1);
+      putCsvString(out, fi->typeName);
+      putData(out, ",", 1);
+      putUInt(out, fi->offset);
+      putData(out, ",", 1);
+      putUInt(out, fi->size);
+      putData(out, ",", 1);
+      putUInt(out, fi->align);
+      putString(out, fi->isSpecial ? ",1" : ",0");
+      putString(out, fi->isBitField ? ",1\n" : ",0\n");
+    }
+    else
+      putString(out, ",,,,,,,,\n");
+  } while (++i < ri->fieldCount);
+}
+
 int compare_size(const void* p1, const void *p2)
 {
   struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
@@ -88,6 +1238,158 @@ int compare_diff(const void* p1, const void *p2)
   return diff2 - diff1;
 }
 
+int compare_cascade(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+
+  if (ri1->cascadeSaving > ri2->cascadeSaving)
+    return -1;
+  else if (ri1->cascadeSaving < ri2->cascadeSaving)
+    return 1;
+
+  return 0;
+}
+
+int compare_static(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+  size_t saving1 = (ri1->estMinSize < ri1->size) ? ri1->staticCount * (ri1->size - ri1->estMinSize) : 0;
+  size_t saving2 = (ri2->estMinSize < ri2->size) ? ri2->staticCount * (ri2->size - ri2->estMinSize) : 0;
+
+  if (saving1 > saving2)
+    return -1;
+  else if (saving1 < saving2)
+    return 1;
+
+  return 0;
+}
+
+int compare_overalign(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+  size_t waste1 = (ri1->naturalSize < ri1->size) ? ri1->size - ri1->naturalSize : 0;
+  size_t waste2 = (ri2->naturalSize < ri2->size) ? ri2->size - ri2->naturalSize : 0;
+
+  if (waste1 > waste2)
+    return -1;
+  else if (waste1 < waste2)
+    return 1;
+
+  // Among equally over-aligned records ones with more static instances cost more
+  if (ri1->staticCount > ri2->staticCount)
+    return -1;
+  else if (ri1->staticCount < ri2->staticCount)
+    return 1;
+
+  return 0;
+}
+
+int compare_padding(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+
+  if (ri1->totalPadding > ri2->totalPadding)
+    return -1;
+  else if (ri1->totalPadding < ri2->totalPadding)
+    return 1;
+
+  return 0;
+}
+
+int compare_hole(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+
+  if (ri1->maxHole > ri2->maxHole)
+    return -1;
+  else if (ri1->maxHole < ri2->maxHole)
+    return 1;
+
+  return 0;
+}
+
+int compare_union(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+
+  if (ri1->unionGap > ri2->unionGap)
+    return -1;
+  else if (ri1->unionGap < ri2->unionGap)
+    return 1;
+
+  return 0;
+}
+
+// Bytes saved by what-if change itself on top of reordering
+size_t extraSaving(const struct RecordInfo* ri, size_t estSize)
+{
+  const size_t reorderedSize = ri->estMinSize < ri->size ? ri->estMinSize : ri->size;
+  return estSize < reorderedSize ? reorderedSize - estSize : 0;
+}
+
+int compare_pointer(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+  size_t saving1 = extraSaving(ri1, ri1->estPointerMinSize);
+  size_t saving2 = extraSaving(ri2, ri2->estPointerMinSize);
+
+  if (saving1 > saving2)
+    return -1;
+  else if (saving1 < saving2)
+    return 1;
+
+  // Among equal savings ones with more static instances save more
+  if (ri1->staticCount > ri2->staticCount)
+    return -1;
+  else if (ri1->staticCount < ri2->staticCount)
+    return 1;
+
+  return 0;
+}
+
+int compare_flat(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+  size_t saving1 = extraSaving(ri1, ri1->estFlatMinSize);
+  size_t saving2 = extraSaving(ri2, ri2->estFlatMinSize);
+
+  if (saving1 > saving2)
+    return -1;
+  else if (saving1 < saving2)
+    return 1;
+
+  if (ri1->staticCount > ri2->staticCount)
+    return -1;
+  else if (ri1->staticCount < ri2->staticCount)
+    return 1;
+
+  return 0;
+}
+
+int compare_alloc(const void* p1, const void *p2)
+{
+  struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
+  struct RecordInfo* ri2 = *(struct RecordInfo**) p2;
+  size_t saving1 = ri1->allocSize - ri1->allocMinSize;
+  size_t saving2 = ri2->allocSize - ri2->allocMinSize;
+
+  if (saving1 > saving2)
+    return -1;
+  else if (saving1 < saving2)
+    return 1;
+
+  // Records closer to next smaller class go first among equal ones
+  return compare_diff(p1, p2);
+}
+
 int compare_name(const void* p1, const void *p2)
 {
   struct RecordInfo* ri1 = *(struct RecordInfo**) p1;
@@ -111,6 +1413,33 @@ void sortStorage(struct RecordStorage* rs, const char* sortSpec)
     case 'n':
       qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_name);
       break;
+    case 'c':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_cascade);
+      break;
+    case 'm':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_static);
+      break;
+    case 'a':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_overalign);
+      break;
+    case 'p':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_padding);
+      break;
+    case 'h':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_hole);
+      break;
+    case 'u':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_union);
+      break;
+    case 'r':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_pointer);
+      break;
+    case 'l':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_alloc);
+      break;
+    case 'w':
+      qsort(rs->records, rs->recordCount, sizeof(struct RecordInfo*), compare_flat);
+      break;
     default:
       break;
     }
@@ -126,15 +1455,57 @@ int main(int argc, char** argv)
     return 1;
   }
 
-  int skipFlags = 0;
+  struct RecordFilter filter;
+  memset(&filter, 0, sizeof(filter));
+  filter.maxFields = SIZE_MAX;
   const char* sortSpec = 0;
+  const char* groupSpec = 0;
+  size_t depth = 1;
+  const char* ownersFile = 0;
+  const char* format = 0;
+  const char* sizeClassSpec = 0;
 
   for (int i = 2; i < argc; i++)
   {
     if (strstr(argv[i], "skip=") == argv[i])
-      skipFlags = parseSkip(argv[i] + 5);
+      filter.skipFlags = parseSkip(argv[i] + 5);
     else if (strstr(argv[i], "sort=") == argv[i])
       sortSpec = argv[i] + 5;
+    else if (strstr(argv[i], "group=") == argv[i])
+      groupSpec = argv[i] + 6;
+    else if (strstr(argv[i], "minpad=") == argv[i])
+      filter.minPadding = strtoul(argv[i] + 7, 0, 10) * 8;
+    else if (strstr(argv[i], "minhole=") == argv[i])
+      filter.minHole = strtoul(argv[i] + 8, 0, 10) * 8;
+    else if (strstr(argv[i], "minwaste=") == argv[i])
+      filter.minWaste = strtoul(argv[i] + 9, 0, 10) * 8;
+    else if (strstr(argv[i], "minsize=") == argv[i])
+      filter.minSize = strtoul(argv[i] + 8, 0, 10) * 8;
+    else if (strstr(argv[i], "fields>") == argv[i])
+      filter.minFields = strtoul(argv[i] + 7, 0, 10) + 1;
+    else if (strstr(argv[i], "fields<") == argv[i])
+    {
+      const size_t limit = strtoul(argv[i] + 7, 0, 10);
+      filter.maxFields = limit ? limit - 1 : 0;
+    }
+    else if (strstr(argv[i], "name=") == argv[i] || strstr(argv[i], "name~=") == argv[i] ||
+      strstr(argv[i], "file=") == argv[i] || strstr(argv[i], "file~=") == argv[i])
+    {
+      const bool isRegex = argv[i][4] == '~';
+      struct Pattern** pattern = *argv[i] == 'n' ? &filter.name : &filter.file;
+      deletePattern(*pattern);
+      *pattern = createPattern(argv[i] + (isRegex ? 6 : 5), isRegex);
+      if (!*pattern)
+        return 1;
+    }
+    else if (strstr(argv[i], "depth=") == argv[i])
+      depth = strtoul(argv[i] + 6, 0, 10);
+    else if (strstr(argv[i], "owners=") == argv[i])
+      ownersFile = argv[i] + 7;
+    else if (strcmp(argv[i], "format=csv") == 0 || strcmp(argv[i], "format=jsonl") == 0)
+      format = argv[i] + 7;
+    else if (strstr(argv[i], "sizeclass=") == argv[i])
+      sizeClassSpec = argv[i] + 10;
     else
     {
       printf("Unknown command-line option: %s\n", argv[i]);
@@ -142,6 +1513,17 @@ int main(int argc, char** argv)
     }
   }
 
+  // Sorting by allocation savings needs size classes, glibc is most common
+  if (!sizeClassSpec && sortSpec && strchr(sortSpec, 'l'))
+    sizeClassSpec = "glibc";
+  struct SizeClassTable* sizeClasses = 0;
+  errno = 0;
+  if (sizeClassSpec && !(sizeClasses = createSizeClassTable(sizeClassSpec)))
+  {
+    printf("Can't load size classes file %s: %s\n", sizeClassSpec, errno ? strerror(errno) : "no size classes");
+    return 2;
+  }
+
   FILE* dumpFile = fopen(argv[1], "r");
   if (!dumpFile)
   {
@@ -152,19 +1534,95 @@ int main(int argc, char** argv)
   struct RecordStorage* rs = loadRecordStorage(dumpFile);
   if (!rs)
   {
-    printf("Can't load dump file %s: I/O error or invalid data in file\n", argv[1]);
+    printf("Can't load dump file %s: %s\n", argv[1], dumpLoadError());
     fclose(dumpFile);
     return 3;
   }
   fclose(dumpFile);
 
-  filterStorage(rs, skipFlags);
+  for (size_t i = 0; i < rs->recordCount; i++)
+  {
+    struct RecordInfo* ri = rs->records[i];
+    measurePadding(ri, &ri->totalPadding, &ri->maxHole);
+
+    size_t largest;
+    size_t secondLargest;
+    if (ri->isUnion && findLargestMembers(ri, &largest, &secondLargest) && secondLargest != SIZE_MAX)
+      ri->unionGap = ri->fields[largest]->size - ri->fields[secondLargest]->size;
+
+    if (sizeClasses)
+    {
+      ri->allocSize = allocationSize(sizeClasses, ri->size) * 8;
+      ri->allocMinSize = ri->estMinSize < ri->size ? allocationSize(sizeClasses, ri->estMinSize) * 8 : ri->allocSize;
+    }
+  }
+  deleteSizeClassTable(sizeClasses);
+
+  // Embedding graph needs all records, so build it before filtering
+  computeCascadeSavings(rs);
+  computeNestedNaturalSizes(rs);
+  filterStorage(rs, &filter);
+  deletePattern(filter.name);
+  deletePattern(filter.file);
   if (sortSpec)
     sortStorage(rs, sortSpec);
 
-  for (size_t i = 0; i < rs->recordCount; i++)
-    printRecordInfo(stdout, rs->records[i], true);
+  if (groupSpec && strcmp(groupSpec, "t") == 0)
+  {
+    printTemplateFamilies(rs);
+    deleteRecordStorage(rs);
+    return finishOutput();
+  }
+
+  if (groupSpec && (strcmp(groupSpec, "d") == 0 || strcmp(groupSpec, "o") == 0))
+  {
+    struct OwnerMapping* mappings = 0;
+    size_t mappingCount = 0;
+    if (*groupSpec == 'o')
+    {
+      if (!ownersFile || !loadOwnerMappings(ownersFile, &mappings, &mappingCount))
+      {
+        printf("Can't load owners file %s: %s\n", ownersFile ? ownersFile : "(none)",
+          ownersFile ? strerror(errno) : "owners= argument is required");
+        deleteRecordStorage(rs);
+        return 2;
+      }
+    }
+
+    printWasteGroups(rs, depth, mappings, mappingCount);
+    for (size_t i = 0; i < mappingCount; i++)
+    {
+      free(mappings[i].prefix);
+      free(mappings[i].owner);
+    }
+    free(mappings);
+    deleteRecordStorage(rs);
+    return finishOutput();
+  }
+
+  if (format)
+  {
+    struct OutputBuffer out;
+    out.file = stdout;
+    out.size = 0;
+    out.capacity = 1 << 20;
+    out.data = (char*)xmalloc(out.capacity);
+    out.failed = false;
+    const bool isCsv = strcmp(format, "csv") == 0;
+    if (isCsv)
+      putCsvHeader(&out);
+    for (size_t i = 0; i < rs->recordCount; i++)
+      if (isCsv)
+        putCsvRecord(&out, rs->records[i]);
+      else
+        putJsonRecord(&out, rs->records[i]);
+    flushOutput(&out);
+    free(out.data);
+  }
+  else
+    for (size_t i = 0; i < rs->recordCount; i++)
+      printRecordInfo(stdout, rs->records[i], true);
 
   deleteRecordStorage(rs);
-  return 0;
+  return finishOutput();
 }
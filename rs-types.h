@@ -3,6 +3,20 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// Size of pointer replaced by offset or index in pointer compression what-if
+#define COMPRESSED_POINTER_SIZE 32
+
+// Size and alignment of part of flattened wrapper field
+struct FlatMember
+{
+  size_t size;
+  size_t align;
+};
+
+// Wrapper is split into at most value (or first) and flag (or index, second)
+#define MAX_FLAT_MEMBERS 2
 
 struct FieldInfo
 {
@@ -10,9 +24,30 @@ struct FieldInfo
   size_t size;
   size_t offset;
   size_t align;
+  // Alignment field would have without alignas() and aligned attributes
+  size_t naturalAlign;
   // Field is base class or vptr
   bool isSpecial;
   bool isBitField;
+  // Name of record type which is embedded by value (directly or as array
+  // element), empty string otherwise
+  char* typeName;
+  // Size and alignment of field if its enum type used smallest sufficient
+  // underlying type, zero if field isn't enum or can't be narrowed
+  size_t enumSize;
+  size_t enumAlign;
+  // Field is plain (not bit-field) bool
+  bool isBool;
+  // Field type is empty class (not array of them)
+  bool isEmpty;
+  // Size and alignment of pointer or reference field (or array of them) if
+  // pointers were compressed, zero if field isn't pointer or can't be shrunk
+  size_t pointerSize;
+  size_t pointerAlign;
+  // Parts std::optional, std::pair or std::variant field would be split into
+  // if its members were hoisted into record, zero count for other fields
+  struct FlatMember flatMembers[MAX_FLAT_MEMBERS];
+  size_t flatCount;
 };
 
 struct RecordInfo
@@ -20,17 +55,53 @@ struct RecordInfo
   struct FieldInfo** fields;
   char* name;
   char* fileName;
+  // Primary template of instantiation, empty string otherwise
+  char* templateName;
   size_t line;
   size_t size;
   size_t align;
+  // Alignment record would have without alignas() and aligned attributes
+  // (on record itself and on its fields)
+  size_t naturalAlign;
   size_t fieldCount;
   // Index of first non-special field
   size_t firstField;
   // Estimated minimal size
   size_t estMinSize;
+  // Estimated minimal size if enum fields are narrowed too
+  size_t estEnumMinSize;
+  // Estimated minimal size if bool fields are packed into flag bytes
+  size_t estBoolMinSize;
+  // Estimated minimal size if empty members take no space
+  // ([[no_unique_address]])
+  size_t estEmptyMinSize;
+  // Estimated minimal size if pointers and references were compressed
+  size_t estPointerMinSize;
+  // Estimated minimal size if wrapper fields were flattened
+  size_t estFlatMinSize;
+  // Size with natural alignments in declaration order
+  size_t naturalSize;
   bool hasBitFields;
   bool isInstance;
   bool hasVirtualBase;
+  // All fields share offset 0
+  bool isUnion;
+  // Number of record instances in static storage (array elements included)
+  size_t staticCount;
+
+  // Following data isn't stored in dump, it is calculated by rs-report
+  // Bytes saved in this record and in all records which embed it (directly or
+  // transitively) if this record is optimized
+  size_t cascadeSaving;
+  // Total padding and largest hole between fields, see measurePadding()
+  size_t totalPadding;
+  size_t maxHole;
+  // Difference between largest and second largest union members
+  size_t unionGap;
+  // Heap allocation size (allocator size class) of actual and estimated
+  // minimal sizes, zero if size classes aren't given
+  size_t allocSize;
+  size_t allocMinSize;
 };
 
 struct RecordStorage
@@ -40,4 +111,11 @@ struct RecordStorage
   size_t recordCapacity;
 };
 
+// Name hashes of all records in dump, sorted
+struct RecordIndex
+{
+  uint64_t* hashes;
+  size_t hashCount;
+};
+
 #endif
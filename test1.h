@@ -21,6 +21,27 @@ class NonOptimal
   char f_char2;
 };
 
+// Records embedding oversized record by value (as field or base) shrink with
+// it. POD base tail padding isn't reused, so derived record shrinks too.
+class EmbedsNonOptimal
+{
+  NonOptimal f_embedded;
+  char f_char;
+};
+
+struct NonOptimalBase
+{
+  int f_int1;
+  char f_char1;
+  int f_int2;
+  char f_char2;
+};
+
+class DerivedNonOptimal : public NonOptimalBase
+{
+  char f_char;
+};
+
 class BitField
 {
   short f_bit1 : 7;
@@ -97,3 +118,26 @@ namespace ns1 {
 }
 
 using ns1::NamespacedClass;
+
+enum SmallEnum { SE_A, SE_B, SE_C };
+// Enum without enumerators can hold any value of underlying type
+enum EmptyEnum {};
+
+class EnumFields
+{
+  SmallEnum f_small;
+  char f_char;
+  EmptyEnum f_empty;
+};
+
+#if __cplusplus >= 201103L
+// Strong typedef idiom
+enum class Handle : unsigned int {};
+
+class HandleFields
+{
+  Handle f_handle;
+  char f_char;
+  Handle f_handle2;
+};
+#endif